@@ -15,6 +15,17 @@ namespace launcher
     }
 
     network_module.connect();
+
+    auto algorithm = network_module.get_server_hash_algorithm();
+
+    if (algorithm == nullptr)
+    {
+      network_module.disconnect();
+      return;
+    }
+
+    // Local hashes are comparable with the server's only if they use the same algorithm.
+    file_module.set_hash_algorithm(algorithm->get_id());
     connection_status = true;
   }
 
@@ -82,15 +93,14 @@ namespace launcher
       return;
     }
 
-    std::vector<std::string> hash_data;
+    std::map<std::string, std::string> updated_files;
 
-    for (const auto& file : file_module.get_file_list())
     {
-      hash_data.push_back(file.first); // push file name
-      hash_data.push_back(file.second.second); // push file hash
+      auto manifest = file_module.get_manifest();
+      updated_files = network_module.update(*manifest, file_module.get_folder_name());
     }
 
-    network_module.update(hash_data, file_module.get_general_hash(), file_module.get_folder_name());
-    file_module.perform_hashing();
+    // Downloaded files were verified while they were written, so only their entries are replaced.
+    file_module.set_file_hashes(updated_files);
   }
 }
@@ -0,0 +1,208 @@
+#include "file_writer.hpp"
+#include <filesystem>
+#include <stdexcept>
+
+namespace launcher
+{
+  file_writer::file_writer(uint32_t buffers_num)
+  {
+    for (uint32_t j = 0; j < buffers_num; j++)
+    {
+      free_buffers.push_back(std::make_unique<buffer>());
+    }
+
+    hash_thread = std::thread{ [this]()
+      {
+        run_stage(hash_queue, &write_queue, &file_writer::hash_piece);
+      } };
+
+    write_thread = std::thread{ [this]()
+      {
+        run_stage(write_queue, nullptr, &file_writer::write_piece);
+      } };
+  }
+
+  file_writer::~file_writer()
+  {
+    {
+      std::lock_guard lock{ mutex };
+      stopped = true;
+    }
+
+    changed.notify_all();
+    hash_thread.join();
+    write_thread.join();
+  }
+
+  void file_writer::run_stage(std::deque<job>& queue, std::deque<job>* next_queue, void (*process)(job&))
+  {
+    std::unique_lock lock{ mutex };
+
+    while (true)
+    {
+      changed.wait(lock, [&]()
+        {
+          return stopped || queue.size();
+        });
+
+      if (stopped)
+      {
+        return;
+      }
+
+      auto current = std::move(queue.front());
+      queue.pop_front();
+
+      // After a failure the rest of the update is dropped, jobs only return their buffers.
+      bool succeeded = failure == nullptr;
+
+      if (succeeded)
+      {
+        lock.unlock();
+
+        try
+        {
+          process(current);
+        }
+        catch (...)
+        {
+          succeeded = false;
+
+          lock.lock();
+          if (!failure)
+          {
+            failure = std::current_exception();
+          }
+          lock.unlock();
+        }
+
+        lock.lock();
+      }
+
+      if (next_queue)
+      {
+        next_queue->push_back(std::move(current));
+      }
+      else
+      {
+        if (current.data)
+        {
+          free_buffers.push_back(std::move(current.data));
+        }
+
+        if (current.last && succeeded)
+        {
+          finished_files.push_back(std::move(current.file));
+        }
+
+        pending_jobs--;
+      }
+
+      changed.notify_all();
+    }
+  }
+
+  void file_writer::hash_piece(job& current)
+  {
+    auto& file = *current.file;
+
+    if (current.last)
+    {
+      file.hash_matches = common::get_base64(file.hasher->finalize()) == file.hash_base64;
+      return;
+    }
+
+    file.hasher->update(current.data ? current.data->data() : current.local_data, current.size);
+  }
+
+  void file_writer::write_piece(job& current)
+  {
+    auto& file = *current.file;
+
+    if (!current.last)
+    {
+      file.output.write(current.data ? current.data->data() : current.local_data, current.size);
+      return;
+    }
+
+    file.output.close();
+    file.local_view.reset();
+
+    // Broken copy is dropped, so the next update doesn't resume it.
+    if (!file.hash_matches)
+    {
+      std::filesystem::remove(file.temp_path);
+
+      if (file.meta_path.size())
+      {
+        std::filesystem::remove(file.meta_path);
+      }
+
+      throw std::runtime_error{ "hash mismatch of the downloaded file " + std::filesystem::path{ file.path }.filename().string() };
+    }
+  }
+
+  void file_writer::push(job new_job)
+  {
+    {
+      std::lock_guard lock{ mutex };
+
+      pending_jobs++;
+      hash_queue.push_back(std::move(new_job));
+    }
+
+    changed.notify_all();
+  }
+
+  std::unique_ptr<file_writer::buffer> file_writer::get_buffer()
+  {
+    std::unique_lock lock{ mutex };
+
+    changed.wait(lock, [&]()
+      {
+        return free_buffers.size() || failure;
+      });
+
+    if (failure)
+    {
+      std::rethrow_exception(failure);
+    }
+
+    auto free_buffer = std::move(free_buffers.back());
+    free_buffers.pop_back();
+
+    return free_buffer;
+  }
+
+  void file_writer::write(std::shared_ptr<incoming_file> file, std::unique_ptr<buffer> data, uint64_t size)
+  {
+    push({ std::move(file), std::move(data), nullptr, size });
+  }
+
+  void file_writer::copy(std::shared_ptr<incoming_file> file, const char* data, uint64_t size)
+  {
+    push({ std::move(file), nullptr, data, size });
+  }
+
+  void file_writer::finish(std::shared_ptr<incoming_file> file)
+  {
+    push({ std::move(file), nullptr, nullptr, 0, true });
+  }
+
+  std::vector<std::shared_ptr<incoming_file>> file_writer::wait()
+  {
+    std::unique_lock lock{ mutex };
+
+    changed.wait(lock, [&]()
+      {
+        return pending_jobs == 0;
+      });
+
+    if (failure)
+    {
+      std::rethrow_exception(failure);
+    }
+
+    return std::move(finished_files);
+  }
+}
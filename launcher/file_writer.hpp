@@ -0,0 +1,146 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "../server/common.hpp"
+#include "../server/content_chunker.hpp"
+#include "../server/file_view.hpp"
+#include "../server/hash_algorithm.hpp"
+#include "staged_file.hpp"
+
+namespace launcher
+{
+  // File being received on a channel of the update stream.
+  struct incoming_file
+  {
+    messages::transfer_modes mode;
+    std::string path; // file in the working directory
+    std::string temp_path; // staged copy, renamed to path once all files of the update are complete
+    std::string meta_path; // version of the partial copy, empty in delta mode
+    staged_file output;
+    uint64_t start_offset = 0; // data of the partial copy received before the transfer was interrupted
+    uint64_t reused_bytes = 0; // data copied from the local copy in delta mode
+    std::unique_ptr<file_view> local_view;
+    const std::vector<content_chunker::chunk>* local_chunks = nullptr; // chunks of the local copy reported to the server
+    std::string hash_base64; // server's hash of the file
+    std::unique_ptr<base_hasher> hasher; // hash of the written data, checked once the file is complete
+    bool hash_matches = false;
+  };
+
+  /*
+  * Hashes and writes received files in the background, so the socket is
+  * read while earlier data is still being hashed and written. Pieces of
+  * files pass the hashing thread and then the writing thread in the order
+  * they were received. New data is kept in a small pool of buffers, the
+  * receiver waits for a free one when the disk falls behind.
+  */
+  class file_writer
+  {
+  public:
+    using buffer = std::vector<char>;
+
+  private:
+    // Piece of the file, its data is in the pooled buffer or in the mapped local copy.
+    struct job
+    {
+      std::shared_ptr<incoming_file> file;
+      std::unique_ptr<buffer> data;
+      const char* local_data = nullptr;
+      uint64_t size = 0;
+      bool last = false; // file is complete
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<job> hash_queue;
+    std::deque<job> write_queue;
+    std::vector<std::unique_ptr<buffer>> free_buffers;
+    std::vector<std::shared_ptr<incoming_file>> finished_files;
+    uint64_t pending_jobs = 0;
+    std::exception_ptr failure; // first error of the workers
+    bool stopped = false;
+    std::thread hash_thread;
+    std::thread write_thread;
+
+  private:
+    /// <summary>
+    /// Put the job into the pipeline.
+    /// </summary>
+    /// <param name="new_job">Job itself.</param>
+    void push(job new_job);
+
+    /// <summary>
+    /// Take jobs from the queue and pass them to the next stage.
+    /// </summary>
+    /// <param name="queue">Input queue of the stage.</param>
+    /// <param name="next_queue">Output queue or nullptr for the last stage.</param>
+    /// <param name="process">Stage itself.</param>
+    void run_stage(std::deque<job>& queue, std::deque<job>* next_queue, void (*process)(job&));
+
+    /// <summary>
+    /// Add data to the hash, verify the hash at the end of the file.
+    /// </summary>
+    /// <param name="current">Job to process.</param>
+    static void hash_piece(job& current);
+
+    /// <summary>
+    /// Write data to the staged copy, close it at the end of the file.
+    /// </summary>
+    /// <param name="current">Job to process.</param>
+    static void write_piece(job& current);
+
+  public:
+    /// <summary>
+    /// Create file writer and start its threads.
+    /// </summary>
+    /// <param name="buffers_num">Number of buffers for data in flight.</param>
+    file_writer(uint32_t buffers_num = 8);
+
+    file_writer(const file_writer&) = delete;
+    file_writer& operator=(const file_writer&) = delete;
+
+    /// <summary>
+    /// Stop threads, pieces that weren't written yet are dropped.
+    /// </summary>
+    ~file_writer();
+
+    /// <summary>
+    /// Get buffer for new data, waits while all buffers are in flight.
+    /// </summary>
+    /// <returns>Buffer, return it with write().</returns>
+    std::unique_ptr<buffer> get_buffer();
+
+    /// <summary>
+    /// Append new data to the file.
+    /// </summary>
+    /// <param name="file">File of the data.</param>
+    /// <param name="data">Buffer from get_buffer().</param>
+    /// <param name="size">Size of the data in the buffer.</param>
+    void write(std::shared_ptr<incoming_file> file, std::unique_ptr<buffer> data, uint64_t size);
+
+    /// <summary>
+    /// Append data of the local copy to the file.
+    /// </summary>
+    /// <param name="file">File of the data, it keeps the local copy mapped.</param>
+    /// <param name="data">Pointer into the local copy.</param>
+    /// <param name="size">Size of the data.</param>
+    void copy(std::shared_ptr<incoming_file> file, const char* data, uint64_t size);
+
+    /// <summary>
+    /// Close the file and verify its hash once all its data is written.
+    /// </summary>
+    /// <param name="file">Complete file.</param>
+    void finish(std::shared_ptr<incoming_file> file);
+
+    /// <summary>
+    /// Wait until all data is written.
+    /// </summary>
+    /// <returns>Files that were finished and verified.</returns>
+    std::vector<std::shared_ptr<incoming_file>> wait();
+  };
+}
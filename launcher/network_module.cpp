@@ -2,6 +2,11 @@
 #include <iostream>
 #include <openssl/ssl.h>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <array>
+#include <span>
+#include "../server/file_view.hpp"
 
 namespace launcher
 {
@@ -27,13 +32,24 @@ namespace launcher
     ssl_stream->lowest_layer().connect(ep);
     ssl_stream->handshake(asio::ssl::stream_base::client);
 
-    // I don't know how to reuse boost archives after disconnection because new server instances cannot read data from client's old ones :/.
-    // So I just decided to recreate them on every connection.
-    request_stream = std::make_unique<boost::archive::binary_oarchive>(request_buf, boost::archive::no_codecvt | boost::archive::no_header);
-    input_stream = std::make_unique<boost::archive::binary_iarchive>(response_buf, boost::archive::no_codecvt | boost::archive::no_header);
+    // Tell the server which hash algorithms and capabilities we support, it answers with the algorithm of its manifest.
+    auto ping_content = get_supported_hash_algorithms();
+    ping_content.push_back(messages::capabilities::zstd);
+    ping_content.push_back(messages::capabilities::tls_stream);
+    ping_content.push_back(messages::capabilities::channels);
 
-    std::cout << "Connection status: \n"
-      << send_and_get({ messages::request_ids::ping });
+    auto response = send_and_get({ messages::request_ids::ping, std::move(ping_content) });
+    std::cout << "Connection status: \n" << response;
+
+    server_algorithm = response.status == messages::status_codes::success && response.response_content.size()
+      ? find_hash_algorithm(response.response_content[0]) : nullptr;
+    compression = std::ranges::find(response.response_content, messages::capabilities::zstd) != response.response_content.end();
+    encrypted_stream = std::ranges::find(response.response_content, messages::capabilities::tls_stream) != response.response_content.end();
+  }
+
+  const hash_algorithm* network::get_server_hash_algorithm() const
+  {
+    return server_algorithm;
   }
 
   void network::sign_in(std::string& login, std::string& password)
@@ -48,53 +64,51 @@ namespace launcher
       << send_and_get({ messages::request_ids::registration, { login, password } });
   }
 
-  void network::get_ready_buffs()
+  uint32_t network::send(messages::request& request)
   {
-    request_buf.clear();
-    request_buf.str("");
+    // Message is prefixed by its size.
+    request_stream.set_correlation_id(++last_correlation_id);
+    request_stream << request;
+    asio::write(*ssl_stream, request_stream.get_buffer());
 
-    if (response_buf.size())
-    {
-      response_buf.consume(response_buf.size());
-    }
+    return last_correlation_id;
   }
 
-  void network::send(messages::request& request)
+  messages::response network::get(uint32_t correlation_id)
   {
-    *request_stream << request;
-
-    uint32_t message_size = common::get_stream_size(request_buf);
-    auto message_size_buf = asio::buffer(&message_size, 4);
+    if (auto early = early_responses.find(correlation_id); early != early_responses.end())
+    {
+      auto response = std::move(early->second);
+      early_responses.erase(early);
 
-    // Write buff size and then buff itself.
-    asio::write(*ssl_stream, message_size_buf);
-    asio::write(*ssl_stream, asio::buffer(request_buf.str()));
-  }
+      return response;
+    }
 
-  messages::response network::get()
-  {
     uint32_t message_size;
     auto message_size_buf = asio::buffer(&message_size, 4);
 
-    // Read buff size and then read buff itself.
-    asio::read(*ssl_stream, message_size_buf);
-    asio::read(*ssl_stream, response_buf.prepare(message_size));
+    while (true)
+    {
+      // Read buff size and then read buff itself.
+      asio::read(*ssl_stream, message_size_buf);
+      asio::read(*ssl_stream, input_stream.prepare(message_size));
 
-    response_buf.commit(message_size);
+      input_stream >> response_view;
 
-    messages::response response;
-    *input_stream >> response;
+      messages::response response{ response_view.status, std::string{ response_view.message }, { response_view.response_content.begin(), response_view.response_content.end() } };
 
-    return response;
+      if (response_view.correlation_id == correlation_id)
+      {
+        return response;
+      }
+
+      early_responses.emplace(response_view.correlation_id, std::move(response));
+    }
   }
 
   messages::response network::send_and_get(messages::request request)
   {
-    send(request);
-    auto response = get();
-    get_ready_buffs();
-
-    return response;
+    return get(send(request));
   }
 
   void network::disconnect()
@@ -105,78 +119,502 @@ namespace launcher
     ssl_stream->shutdown(e);
     ssl_stream->lowest_layer().close();
     ssl_stream.reset();
-
-    request_stream.reset();
-    input_stream.reset();
+    early_responses.clear();
 
     std::cout << "Disconnected\n\n";
   }
 
-  void network::update(std::vector<std::string>& hash_data, std::string general_hash, std::string folder_name)
+  messages::response network::find_changed_files(const manifest& local_manifest, std::map<std::string, std::string>& changed_files, uint32_t level, std::vector<uint32_t> differing_nodes)
+  {
+    messages::response response;
+
+    // Descend level by level, asking only for children of nodes that differ.
+    for (; level < merkle_tree::depth && differing_nodes.size(); level++)
+    {
+      messages::request request{ messages::request_ids::get_merkle_nodes };
+
+      for (uint32_t index : differing_nodes)
+      {
+        request.request_content.push_back(merkle_tree::make_node_id(level, index));
+      }
+
+      response = send_and_get(std::move(request));
+
+      if (response.status != messages::status_codes::success)
+      {
+        return response;
+      }
+
+      if (response.response_content.size() != differing_nodes.size() * merkle_tree::fanout)
+      {
+        return messages::response{ messages::status_codes::fail, "invalid merkle nodes response", {} };
+      }
+
+      std::vector<uint32_t> next_nodes;
+
+      for (uint32_t j = 0; j < differing_nodes.size(); j++)
+      {
+        for (uint32_t k = 0; k < merkle_tree::fanout; k++)
+        {
+          uint32_t child = differing_nodes[j] * merkle_tree::fanout + k;
+          auto& server_hash = response.response_content[j * merkle_tree::fanout + k];
+
+          // Subtrees that are empty on the server contain nothing to download.
+          if (server_hash.size() && server_hash != local_manifest.tree.get_node(level + 1, child))
+          {
+            next_nodes.push_back(child);
+          }
+        }
+      }
+
+      differing_nodes = std::move(next_nodes);
+    }
+
+    if (differing_nodes.empty())
+    {
+      return messages::response{ messages::status_codes::success, {}, {} };
+    }
+
+    messages::request request{ messages::request_ids::get_merkle_buckets };
+
+    for (uint32_t index : differing_nodes)
+    {
+      request.request_content.push_back(merkle_tree::make_node_id(merkle_tree::depth, index));
+    }
+
+    response = send_and_get(std::move(request));
+
+    if (response.status == messages::status_codes::success)
+    {
+      pick_changed_files(local_manifest, response.response_content, 0, changed_files);
+    }
+
+    return response;
+  }
+
+  void network::pick_changed_files(const manifest& local_manifest, std::vector<std::string>& file_list, size_t first, std::map<std::string, std::string>& changed_files)
   {
-    auto response = send_and_get({ messages::request_ids::check_general_hash, { std::move(general_hash) } });
+    for (size_t j = first; j + 1 < file_list.size(); j += 2)
+    {
+      auto& name = file_list[j];
+      auto& hash = file_list[j + 1];
+      auto local_file = local_manifest.file_list.find(name);
+
+      if (local_file == local_manifest.file_list.end() || local_file->second.second != hash)
+      {
+        changed_files.emplace(std::move(name), std::move(hash));
+      }
+    }
+  }
+
+  std::map<std::string, std::string> network::update(const manifest& local_manifest, std::string folder_name)
+  {
+    // Up-to-date launcher gets an empty answer in one round trip. Otherwise the server sends the diff plan
+    // from the launcher's release or the merkle nodes that differ from the digest.
+    auto response = send_and_get({ messages::request_ids::sync, { local_manifest.general_hash_base64, local_manifest.tree.get_digest() } });
 
     if (response.status == messages::status_codes::success)
     {
       std::cout << "Already up-to-date.\n\n";
-      return;
+      return {};
+    }
+
+    if (response.status != messages::status_codes::hash_miss)
+    {
+      std::cout << "Update status:" << '\n' << response;
+      return {};
+    }
+
+    std::map<std::string, std::string> changed_files;
+    auto& content = response.response_content;
+
+    if (content.size() && content[0] == messages::sync_answers::plan)
+    {
+      pick_changed_files(local_manifest, content, 1, changed_files);
     }
+    else if (content.size() && content[0] == messages::sync_answers::nodes)
+    {
+      // Server found differing subtrees from the digest, only they are walked.
+      std::vector<uint32_t> differing_nodes;
 
-    auto request = messages::request{ messages::request_ids::get_update, std::move(hash_data) };
-    send(request);
+      for (auto&& node_id : std::span{ content }.subspan(1))
+      {
+        differing_nodes.push_back(merkle_tree::parse_node_id(node_id).second);
+      }
 
-    asio::streambuf input_buf;
-    uint32_t chunk_size;
+      response = find_changed_files(local_manifest, changed_files, merkle_tree::digest_level, std::move(differing_nodes));
 
-    bool continuator;
+      if (response.status != messages::status_codes::success)
+      {
+        std::cout << "Update status:" << '\n' << response;
+        return {};
+      }
+    }
+    else
+    {
+      std::cout << "Update status:" << '\n' << messages::response{ messages::status_codes::fail, "invalid sync response", {} };
+      return {};
+    }
 
-    while(true)
+    // Local directory has extra files only.
+    if (changed_files.empty())
     {
-      // Firstly we read file name and create filestream.
-      asio::read_until(*ssl_stream, input_buf, '\0');
-      std::string_view file_name = reinterpret_cast<const char*>(input_buf.data().data());
+      std::cout << "Already up-to-date.\n\n";
+      return {};
+    }
 
-      // If client receives 'stop' then all files are up-to-date.
-      if (!file_name.compare("stop") ? true : false)
+    // Interrupted transfers are kept outside of the working directory, so they aren't hashed as local files.
+    auto partial_folder = folder_name + ".partial";
+    std::filesystem::create_directories(partial_folder);
+
+    // Continue partial copies of the same version of the file, otherwise report
+    // chunks of large local files, so the server sends only the missing ones.
+    std::map<std::string, std::vector<content_chunker::chunk>> local_chunks;
+    std::map<std::string, uint64_t> resume_offsets;
+    auto request = messages::request{ messages::request_ids::get_update };
+
+    for (auto&& [name, hash] : changed_files)
+    {
+      messages::update_entry entry{ name, 0, {} };
+      auto local_file = local_manifest.file_list.find(name);
+
+      if (uint64_t partial_size = get_partial_size(partial_folder, name, hash); partial_size >= common::consts::MiB)
+      {
+        // Tail of the partial copy may be lost if the launcher crashed, so only whole blocks are kept.
+        entry.resume_offset = partial_size / common::consts::MiB * common::consts::MiB;
+        resume_offsets[name] = entry.resume_offset;
+      }
+      else if (local_file != local_manifest.file_list.end() && std::filesystem::file_size(local_file->second.first) >= common::consts::delta_min_file_size)
+      {
+        file_view view{ local_file->second.first };
+        auto& chunks = local_chunks[name] = content_chunker::split(view.data(), view.size());
+
+        entry.local_hashes = content_chunker::pack_hashes(chunks);
+      }
+
+      request.add_update_entry(entry);
+    }
+
+    auto update_id = send(request);
+
+    std::map<std::string, std::string> updated_files;
+    uint64_t received_bytes = 0, reused_bytes = 0, resumed_bytes = 0;
+    stream_received = 0;
+    stream_acked = 0;
+
+    // Socket is read while earlier data is hashed and written on the writer's threads.
+    file_writer writer;
+
+    // Frames of files sent on different channels are interleaved. Key is channel id.
+    std::map<uint16_t, std::shared_ptr<incoming_file>> channels;
+
+    // Acknowledgements always go through the ssl layer.
+    while (true)
+    {
+      auto header = read_frame();
+
+      // If client receives 'end' then all files are up-to-date.
+      if (header.type == messages::frame_types::end)
       {
+        if (channels.size())
+        {
+          throw std::runtime_error{ "update stream ended in the middle of a file" };
+        }
+
         break;
       }
 
-      std::ofstream updated_file{ (folder_name + "\\" + file_name.data()), std::ios::trunc | std::ios::binary};
-      std::vector<char> file_buff;
-      file_buff.resize(common::consts::MiB);
+      if (header.type != messages::frame_types::file)
+      {
+        auto channel = channels.find(header.channel);
+
+        if (channel == channels.end())
+        {
+          throw std::runtime_error{ "frame of a channel without file" };
+        }
+
+        if (header.type != messages::frame_types::end_of_file)
+        {
+          receive_frame(header, channel->second, writer);
+          continue;
+        }
+
+        writer.finish(std::move(channel->second));
+        channels.erase(channel);
+        continue;
+      }
+
+      messages::transfer_modes mode;
+      uint64_t file_size;
 
-      // Read data from the server in cycle and write it to file.
-      while (true)
+      if (header.size < sizeof(mode) + sizeof(file_size) || header.size > 0x10000 || channels.contains(header.channel))
       {
-        // Read chunk size.
-        asio::read(*ssl_stream, asio::buffer(&chunk_size, sizeof(chunk_size)));
+        throw std::runtime_error{ "invalid file frame" };
+      }
+
+      // Firstly we read transfer mode, size and name of the file.
+      std::string file_name;
+      file_name.resize(header.size - sizeof(mode) - sizeof(file_size));
+
+      read_stream(reinterpret_cast<char*>(&mode), sizeof(mode));
+      read_stream(reinterpret_cast<char*>(&file_size), sizeof(file_size));
+      read_stream(file_name.data(), file_name.size());
+
+      auto server_file = changed_files.find(file_name);
+
+      if (server_file == changed_files.end())
+      {
+        throw std::runtime_error{ "unexpected file" };
+      }
+
+      auto new_file = std::make_shared<incoming_file>(mode, (std::filesystem::path{ folder_name } / file_name).string());
+      auto& file = *new_file;
+      file.hash_base64 = server_file->second;
+      file.hasher = std::make_unique<file_hasher>(*server_algorithm);
 
-        if (!chunk_size)
+      if (mode == messages::transfer_modes::full || mode == messages::transfer_modes::resume)
+      {
+        // Data goes to the partial copy first, it's moved into the working directory once complete.
+        file.temp_path = (std::filesystem::path{ partial_folder } / (file_name + ".part")).string();
+        file.meta_path = (std::filesystem::path{ partial_folder } / (file_name + ".meta")).string();
+
+        if (mode == messages::transfer_modes::resume)
+        {
+          auto resume_offset = resume_offsets.find(file_name);
+
+          if (resume_offset == resume_offsets.end())
+          {
+            throw std::runtime_error{ "unexpected resumed transfer" };
+          }
+
+          file.start_offset = resume_offset->second;
+          file.output = staged_file{ file.temp_path, file_size, file.start_offset };
+
+          // Only the kept part of the copy is read back for the hash.
+          file_view partial_view{ file.temp_path };
+          file.hasher->update(partial_view.data(), file.start_offset);
+        }
+        else
         {
-          updated_file.close();
-          break;
+          // Meta file tells which version of the file the partial copy belongs to.
+          std::ofstream meta_file{ file.meta_path, std::ios::trunc | std::ios::binary };
+          meta_file << server_file->second;
+
+          file.output = staged_file{ file.temp_path, file_size };
         }
+      }
+      else if (mode == messages::transfer_modes::delta)
+      {
+        auto local_file = local_chunks.find(file_name);
 
-        if (chunk_size < file_buff.size())
+        if (local_file == local_chunks.end())
         {
-          file_buff.resize(chunk_size);
+          throw std::runtime_error{ "unexpected delta transfer" };
         }
 
-        asio::write(*ssl_stream, asio::buffer(&continuator, sizeof(continuator)));
-        asio::read(ssl_stream->next_layer(), asio::buffer(file_buff));
-        asio::write(*ssl_stream, asio::buffer(&continuator, sizeof(continuator)));
-        // These two asio::write lines are the necessary synchronization before and after non ssl transmission.
+        // Local copy is read while the new file is assembled, so the new one is staged and swapped in.
+        file.path = local_manifest.file_list.at(file_name).first;
+        file.temp_path = (std::filesystem::path{ partial_folder } / (file_name + ".delta")).string();
+        file.local_view = std::make_unique<file_view>(file.path);
+        file.local_chunks = &local_file->second;
+        file.output = staged_file{ file.temp_path, file_size };
+      }
+      else
+      {
+        throw std::runtime_error{ "invalid transfer mode" };
+      }
+
+      channels.emplace(header.channel, std::move(new_file));
+    }
 
-        updated_file.write(file_buff.data(), chunk_size);
+    // Server sends the response after it gets the last acknowledgement.
+    send_ack();
+
+    // Working directory stays untouched until the whole update is written and verified.
+    auto staged_files = writer.wait();
+
+    // Every file is replaced by a single rename, the game never sees a half written file.
+    for (auto&& file : staged_files)
+    {
+      std::filesystem::rename(file->temp_path, file->path);
+
+      if (file->meta_path.size())
+      {
+        std::filesystem::remove(file->meta_path);
       }
 
-      input_buf.consume(input_buf.size());
+      updated_files[std::filesystem::path{ file->path }.filename().string()] = file->hash_base64;
+
+      received_bytes += file->output.size() - file->start_offset - file->reused_bytes;
+      resumed_bytes += file->start_offset;
+      reused_bytes += file->reused_bytes;
     }
 
-    response = get();
-    get_ready_buffs();
-    
+    std::cout << "Downloaded " << received_bytes / common::consts::MiB << " MB, reused " << reused_bytes / common::consts::MiB << " MB of local data, resumed "
+      << resumed_bytes / common::consts::MiB << " MB of interrupted downloads\n";
+
+    if (compression)
+    {
+      std::cout << "Transferred " << stream_received / common::consts::MiB << " MB of compressed data\n";
+    }
+
+    response = get(update_id);
+
     std::cout << "Update status:" << '\n' << response;
+
+    return updated_files;
+  }
+
+  uint64_t network::get_partial_size(const std::string& partial_folder, const std::string& file_name, const std::string& file_hash)
+  {
+    auto part_path = std::filesystem::path{ partial_folder } / (file_name + ".part");
+    std::ifstream meta_file{ std::filesystem::path{ partial_folder } / (file_name + ".meta"), std::ios::binary };
+    std::string partial_hash{ std::istreambuf_iterator<char>{ meta_file }, std::istreambuf_iterator<char>{} };
+    std::error_code e;
+
+    if (partial_hash != file_hash || !std::filesystem::is_regular_file(part_path, e))
+    {
+      return 0;
+    }
+
+    uint64_t size = std::filesystem::file_size(part_path, e);
+
+    return e ? 0 : size;
+  }
+
+  void network::read_stream(char* data, uint64_t size)
+  {
+    if (encrypted_stream)
+    {
+      asio::read(*ssl_stream, asio::buffer(data, size));
+    }
+    else
+    {
+      asio::read(ssl_stream->next_layer(), asio::buffer(data, size));
+    }
+
+    stream_received += size;
+
+    // Server keeps sending while the unacknowledged part of the stream fits its window.
+    if (stream_received - stream_acked >= common::consts::stream_ack_interval)
+    {
+      send_ack();
+    }
+  }
+
+  void network::send_ack()
+  {
+    asio::write(*ssl_stream, asio::buffer(&stream_received, sizeof(stream_received)));
+    stream_acked = stream_received;
+  }
+
+  messages::frame_header network::read_frame()
+  {
+    messages::frame_header header;
+    read_stream(reinterpret_cast<char*>(&header), sizeof(header));
+
+    return header;
+  }
+
+  uint32_t network::receive_data(const messages::frame_header& header, std::vector<char>& file_buff)
+  {
+    if (file_buff.size() < common::consts::MiB)
+    {
+      file_buff.resize(common::consts::MiB);
+    }
+
+    if (header.type == messages::frame_types::data)
+    {
+      if (header.size > common::consts::MiB)
+      {
+        throw std::runtime_error{ "invalid data frame" };
+      }
+
+      read_stream(file_buff.data(), header.size);
+      return header.size;
+    }
+
+    uint32_t raw_size;
+
+    if (!compression || header.size < sizeof(raw_size) || header.size - sizeof(raw_size) > common::consts::MiB)
+    {
+      throw std::runtime_error{ "invalid compressed data frame" };
+    }
+
+    read_stream(reinterpret_cast<char*>(&raw_size), sizeof(raw_size));
+
+    uint32_t stored_size = header.size - sizeof(raw_size);
+
+    if (raw_size > common::consts::MiB)
+    {
+      throw std::runtime_error{ "invalid compressed data frame" };
+    }
+
+    if (stored_size > compressed_buff.size())
+    {
+      compressed_buff.resize(stored_size);
+    }
+
+    read_stream(compressed_buff.data(), stored_size);
+
+    if (decompression_context == nullptr)
+    {
+      decompression_context.reset(ZSTD_createDCtx());
+
+      if (decompression_context == nullptr)
+      {
+        throw std::runtime_error{ "failed to create decompression context" };
+      }
+    }
+
+    size_t result = ZSTD_decompressDCtx(decompression_context.get(), file_buff.data(), raw_size, compressed_buff.data(), stored_size);
+
+    if (ZSTD_isError(result) || result != raw_size)
+    {
+      throw std::runtime_error{ "failed to decompress data frame" };
+    }
+
+    return raw_size;
+  }
+
+  void network::receive_frame(const messages::frame_header& header, const std::shared_ptr<incoming_file>& file, file_writer& writer)
+  {
+    if (header.type == messages::frame_types::data || header.type == messages::frame_types::compressed_data)
+    {
+      auto file_buff = writer.get_buffer();
+      uint32_t size = receive_data(header, *file_buff);
+      writer.write(file, std::move(file_buff), size);
+      return;
+    }
+
+    if (header.type != messages::frame_types::copy || file->mode != messages::transfer_modes::delta)
+    {
+      throw std::runtime_error{ "invalid frame of the file" };
+    }
+
+    std::array<uint32_t, 2> copy_range;
+
+    if (header.size != sizeof(copy_range))
+    {
+      throw std::runtime_error{ "invalid copy frame" };
+    }
+
+    read_stream(reinterpret_cast<char*>(copy_range.data()), sizeof(copy_range));
+
+    auto [first_index, count] = copy_range;
+    auto& local_chunks = *file->local_chunks;
+
+    if (!count || first_index >= local_chunks.size() || count > local_chunks.size() - first_index)
+    {
+      throw std::runtime_error{ "delta refers to a missing local chunk" };
+    }
+
+    // Copied chunks follow each other in the local file too.
+    auto& first = local_chunks[first_index];
+    auto& last = local_chunks[first_index + count - 1];
+    uint64_t length = last.offset + last.length - first.offset;
+
+    writer.copy(file, file->local_view->data() + first.offset, length);
+    file->reused_bytes += length;
   }
-}
+}
\ No newline at end of file
@@ -3,6 +3,14 @@
 #include <boost/asio/ssl.hpp>
 #include <memory>
 #include "../server/common.hpp"
+#include "../server/message_codec.hpp"
+#include "../server/file_handler.hpp"
+#include "../server/content_chunker.hpp"
+#include "../server/file_view.hpp"
+#include "file_writer.hpp"
+#include <fstream>
+#include <map>
+#include <zstd.h>
 
 namespace asio = boost::asio;
 
@@ -16,18 +24,20 @@ namespace launcher
     asio::ssl::context ssl_context;
     std::unique_ptr<asio::ssl::stream<asio::ip::tcp::socket>> ssl_stream;
     asio::ip::tcp::endpoint ep;
-    std::stringstream request_buf;
-    asio::streambuf response_buf;
-    std::unique_ptr<boost::archive::binary_oarchive> request_stream; // serialized data
-    std::unique_ptr<boost::archive::binary_iarchive> input_stream;
+    messages::message_writer request_stream; // encoded request, reused between requests
+    messages::message_reader input_stream; // payload of the last response
+    messages::response_view response_view;
+    uint32_t last_correlation_id = 0; // id of the last sent request
+    std::map<uint32_t, messages::response> early_responses; // responses that came before the one being waited for
+    const hash_algorithm* server_algorithm = nullptr; // agreed during ping
+    bool compression = false; // server sends compressed chunks, agreed during ping
+    bool encrypted_stream = false; // update stream goes through tls, agreed during ping
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> decompression_context{ nullptr, &ZSTD_freeDCtx };
+    std::vector<char> compressed_buff;
+    uint64_t stream_received = 0; // bytes of the update stream
+    uint64_t stream_acked = 0;
 
   private:
-    /// <summary>
-    /// Clear buffs after network operation. It is needed
-    /// for buffers reusing.
-    /// </summary>
-    void get_ready_buffs();
-
     /// <summary>
     /// Perform sequentional send and get operations.
     /// </summary>
@@ -36,16 +46,85 @@ namespace launcher
     messages::response send_and_get(messages::request request);
 
     /// <summary>
-    /// Perform response getting.
+    /// Walk the server's merkle tree from the given nodes and find files
+    /// that are missing or differ locally. Only subtrees with
+    /// differing hashes are requested.
+    /// </summary>
+    /// <param name="local_manifest">State of local files.</param>
+    /// <param name="changed_files">Output map of files to download, key is file name, value is the server's hash of the file.</param>
+    /// <param name="level">Level of the nodes.</param>
+    /// <param name="differing_nodes">Indices of nodes whose hashes differ from the local ones.</param>
+    /// <returns>Final response of the walk.</returns>
+    messages::response find_changed_files(const manifest& local_manifest, std::map<std::string, std::string>& changed_files, uint32_t level, std::vector<uint32_t> differing_nodes);
+
+    /// <summary>
+    /// Pick files that are missing or differ locally from the server's list.
+    /// </summary>
+    /// <param name="local_manifest">State of local files.</param>
+    /// <param name="file_list">Pairs of file name and hash in base64 encoding, strings are moved out.</param>
+    /// <param name="first">Index of the first pair in the list.</param>
+    /// <param name="changed_files">Output map of files to download, key is file name, value is the server's hash of the file.</param>
+    static void pick_changed_files(const manifest& local_manifest, std::vector<std::string>& file_list, size_t first, std::map<std::string, std::string>& changed_files);
+
+    /// <summary>
+    /// Get size of the partial copy left by an interrupted transfer.
+    /// </summary>
+    /// <param name="partial_folder">Directory with partial copies.</param>
+    /// <param name="file_name">Name of the file.</param>
+    /// <param name="file_hash">Server's hash of the file, partial copies of other versions are ignored.</param>
+    /// <returns>Size of the partial copy or 0 if there is no copy of this version.</returns>
+    static uint64_t get_partial_size(const std::string& partial_folder, const std::string& file_name, const std::string& file_hash);
+
+    /// <summary>
+    /// Read the update stream through the ssl layer or past it. Received bytes
+    /// are acknowledged through the ssl layer every stream_ack_interval.
+    /// </summary>
+    /// <param name="data">Output buffer.</param>
+    /// <param name="size">Size of the data.</param>
+    void read_stream(char* data, uint64_t size);
+
+    /// <summary>
+    /// Acknowledge all received bytes of the update stream.
     /// </summary>
+    void send_ack();
+
+    /// <summary>
+    /// Read header of the next frame of the update stream.
+    /// </summary>
+    /// <returns>Frame header.</returns>
+    messages::frame_header read_frame();
+
+    /// <summary>
+    /// Read payload of the data frame and decompress it if needed.
+    /// </summary>
+    /// <param name="header">Header of the data frame.</param>
+    /// <param name="file_buff">Output buffer, it gets the raw data.</param>
+    /// <returns>Size of the raw data.</returns>
+    uint32_t receive_data(const messages::frame_header& header, std::vector<char>& file_buff);
+
+    /// <summary>
+    /// Pass data or copy frame to the writer of the file of its channel. In delta mode the
+    /// file is rebuilt from chunks of the local copy and new data sent by the server.
+    /// </summary>
+    /// <param name="header">Header of the frame.</param>
+    /// <param name="file">File of the channel.</param>
+    /// <param name="writer">Writer of the received files.</param>
+    void receive_frame(const messages::frame_header& header, const std::shared_ptr<incoming_file>& file, file_writer& writer);
+
+    /// <summary>
+    /// Get response to the request. Responses to other requests that come
+    /// first are kept until they are asked for.
+    /// </summary>
+    /// <param name="correlation_id">Id returned by send().</param>
     /// <returns>Response struct from the server.</returns>
-    messages::response get();
+    messages::response get(uint32_t correlation_id);
 
     /// <summary>
-    /// Perform request sending.
+    /// Perform request sending. Several requests may be sent before their responses are read.
     /// </summary>
     /// <param name="request">Request struct itself.</param>
-    void send(messages::request& request);
+    /// <returns>Correlation id of the request.</returns>
+    uint32_t send(messages::request& request);
 
   public:
     /// <summary>
@@ -75,18 +154,28 @@ namespace launcher
     /// </summary>
     void connect();
 
+    /// <summary>
+    /// Get hash algorithm of the server's manifest.
+    /// </summary>
+    /// <returns>Pointer to the algorithm or nullptr if the server uses an unsupported one.</returns>
+    const hash_algorithm* get_server_hash_algorithm() const;
+
     /// <summary>
     /// Perform disconnect from the server.
     /// </summary>
     void disconnect();
 
     /// <summary>
-    /// Perform files update.
+    /// Perform files update. Downloaded files are staged in the '<folder_name>.partial'
+    /// directory, so an interrupted download is continued by the next update. Files of
+    /// the working directory are replaced only after all downloaded files are verified.
     /// Since SSL protocol is too slow for transferring files a regular tcp socket is used for this purpose.
+    /// Files are hashed while they are written and checked against the server's hashes.
+    /// Changed files are found with a single sync request carrying the digest of the local merkle tree.
     /// </summary>
-    /// <param name="hash_data">Vector with file names and its hashes.</param>
-    /// <param name="general_hash">Hash of all files to quickly check the relevance of files.</param>
+    /// <param name="local_manifest">State of local files. Its general hash is used to quickly check the relevance of files.</param>
     /// <param name="folder_name">Working directory.</param>
-    void update(std::vector<std::string>& hash_data, std::string general_hash, std::string folder_name);
+    /// <returns>Hashes of the downloaded files, key is file name.</returns>
+    std::map<std::string, std::string> update(const manifest& local_manifest, std::string folder_name);
   };
 }
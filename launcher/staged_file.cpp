@@ -0,0 +1,165 @@
+#include "staged_file.hpp"
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace launcher
+{
+  staged_file::staged_file(const std::string& path, uint64_t final_size, uint64_t offset) : file_name{ std::filesystem::path{ path }.filename().string() },
+    file_size{ offset }
+  {
+#ifdef _WIN32
+    file_handle = CreateFileW(std::filesystem::path{ path }.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+      file_handle = nullptr;
+      throw std::runtime_error{ ("failed to open file: " + file_name).c_str() };
+    }
+
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+
+    if (!SetFilePointerEx(file_handle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file_handle))
+    {
+      close_handle();
+      throw std::runtime_error{ ("failed to truncate file: " + file_name).c_str() };
+    }
+
+    // Allocation size doesn't move the end of file. Failure only costs fragmentation.
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = std::max(final_size, offset);
+    SetFileInformationByHandle(file_handle, FileAllocationInfo, &allocation, sizeof(allocation));
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+      throw std::runtime_error{ ("failed to open file: " + file_name).c_str() };
+    }
+
+    if (::ftruncate(fd, offset) || ::lseek(fd, offset, SEEK_SET) == -1)
+    {
+      close_handle();
+      throw std::runtime_error{ ("failed to truncate file: " + file_name).c_str() };
+    }
+
+#ifdef __linux__
+    // Size of the file stays at the offset. Failure only costs fragmentation, e.g. on file systems without fallocate.
+    if (final_size > offset)
+    {
+      ::fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, final_size - offset);
+    }
+#endif
+#endif
+  }
+
+  staged_file::staged_file(staged_file&& obj) noexcept
+  {
+    *this = std::move(obj);
+  }
+
+  staged_file& staged_file::operator=(staged_file&& obj) noexcept
+  {
+    if (this != &obj)
+    {
+      close_handle();
+
+#ifdef _WIN32
+      file_handle = std::exchange(obj.file_handle, nullptr);
+#else
+      fd = std::exchange(obj.fd, -1);
+#endif
+      file_name = std::move(obj.file_name);
+      file_size = std::exchange(obj.file_size, 0);
+    }
+
+    return *this;
+  }
+
+  staged_file::~staged_file()
+  {
+    close_handle();
+  }
+
+  void staged_file::close_handle()
+  {
+#ifdef _WIN32
+    if (file_handle)
+    {
+      CloseHandle(file_handle);
+    }
+
+    file_handle = nullptr;
+#else
+    if (fd != -1)
+    {
+      ::close(fd);
+    }
+
+    fd = -1;
+#endif
+  }
+
+  void staged_file::write(const char* data, uint64_t size)
+  {
+    while (size)
+    {
+#ifdef _WIN32
+      DWORD written = 0;
+
+      if (!WriteFile(file_handle, data, static_cast<DWORD>(std::min<uint64_t>(size, 0x40000000)), &written, nullptr))
+      {
+        throw std::runtime_error{ ("failed to write file: " + file_name).c_str() };
+      }
+#else
+      ssize_t written = ::write(fd, data, std::min<uint64_t>(size, 0x40000000));
+
+      if (written == -1 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (written <= 0)
+      {
+        throw std::runtime_error{ ("failed to write file: " + file_name).c_str() };
+      }
+#endif
+
+      data += written;
+      size -= written;
+      file_size += written;
+    }
+  }
+
+  void staged_file::close()
+  {
+    // Data must be on the disk before the file is renamed over the old one.
+#ifdef _WIN32
+    bool flushed = FlushFileBuffers(file_handle);
+#else
+    bool flushed = !::fdatasync(fd);
+#endif
+
+    close_handle();
+
+    if (!flushed)
+    {
+      throw std::runtime_error{ ("failed to flush file: " + file_name).c_str() };
+    }
+  }
+
+  uint64_t staged_file::size() const
+  {
+    return file_size;
+  }
+}
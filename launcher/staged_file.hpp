@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+namespace launcher
+{
+  /*
+  * Downloaded file that is written sequentially into the staging area.
+  * Space for the whole file is reserved up front, so big files are laid
+  * out in a few extents instead of growing by 1 MiB appends. The size of
+  * the file still grows with the written data only, so an interrupted
+  * copy can be continued from its end.
+  */
+  class staged_file
+  {
+  private:
+#ifdef _WIN32
+    void* file_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+    std::string file_name;
+    uint64_t file_size = 0;
+
+  private:
+    /// <summary>
+    /// Close the handle.
+    /// </summary>
+    void close_handle();
+
+  public:
+    staged_file() = default;
+
+    /// <summary>
+    /// Open the file for writing and reserve space for it.
+    /// </summary>
+    /// <param name="path">Path to the file in the staging area.</param>
+    /// <param name="final_size">Size of the complete file.</param>
+    /// <param name="offset">Data before the offset is kept and writing continues from it, the rest is discarded.</param>
+    staged_file(const std::string& path, uint64_t final_size, uint64_t offset = 0);
+
+    staged_file(const staged_file&) = delete;
+    staged_file& operator=(const staged_file&) = delete;
+
+    /// <summary>
+    /// Staged file move constructor.
+    /// </summary>
+    /// <param name="obj"></param>
+    staged_file(staged_file&& obj) noexcept;
+
+    /// <summary>
+    /// Staged file move assignment.
+    /// </summary>
+    /// <param name="obj"></param>
+    /// <returns></returns>
+    staged_file& operator=(staged_file&& obj) noexcept;
+
+    ~staged_file();
+
+    /// <summary>
+    /// Append data to the file.
+    /// </summary>
+    /// <param name="data">Pointer to the data.</param>
+    /// <param name="size">Size of the data.</param>
+    void write(const char* data, uint64_t size);
+
+    /// <summary>
+    /// Flush the file and close it.
+    /// </summary>
+    void close();
+
+    /// <summary>
+    /// File size getter.
+    /// </summary>
+    /// <returns>Number of bytes in the file.</returns>
+    uint64_t size() const;
+  };
+}
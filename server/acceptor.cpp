@@ -1,11 +1,12 @@
 #include "acceptor.hpp"
 #include "session.hpp"
+#include "kernel_tls.hpp"
 
 namespace launcher
 {
-	acceptor::acceptor(asio::io_context& ioc_, uint16_t port_num, std::pair<std::shared_ptr<db::database>, std::shared_ptr<file_handler>>& db_fh_) : ioc{ ioc_ },
+	acceptor::acceptor(asio::io_context& ioc_, uint16_t port_num, session_modules& modules_) : ioc{ ioc_ },
 		sock_acceptor{ ioc_, asio::ip::tcp::endpoint{ asio::ip::address_v4::any(), port_num } },
-		ssl_context{ asio::ssl::context::sslv23_server }, db_fh{ db_fh_ }
+		ssl_context{ asio::ssl::context::sslv23_server }, modules{ modules_ }
 	{
 		ssl_context.set_options
 		(boost::asio::ssl::context::default_workarounds
@@ -28,15 +29,24 @@ namespace launcher
 		ssl_context.use_private_key_file(source_directory + "/user.key", boost::asio::ssl::context::pem);
 		ssl_context.use_tmp_dh_file(source_directory + "/dh2048.pem");
 
+		// Sessions install their write keys into the kernel after the handshake.
+		if (modules.encrypted_stream)
+		{
+			kernel_tls::prepare_context(ssl_context);
+		}
+
 		sock_acceptor.listen();
 	}
 
 	void acceptor::accept()
 	{
-		auto ssl_session = std::make_shared<session>(ioc, ssl_context, db_fh.first, db_fh.second);
+		// Memory of finished sessions is reused under connection churn.
+		auto ssl_session = std::allocate_shared<session>(recycling_allocator<session>{}, ioc, ssl_context, modules);
 		sock_acceptor.accept(ssl_session->return_lowest_layer());
 
-		asio::co_spawn(ioc, session::handle_client(std::move(ssl_session)), asio::detached);
+		// Coroutines of the session run on the strand of its socket.
+		auto executor = ssl_session->return_lowest_layer().get_executor();
+		asio::co_spawn(executor, session::handle_client(std::move(ssl_session)), asio::detached);
 	}
 
 	std::string acceptor::password_callback(uint64_t max_length, asio::ssl::context::password_purpose purpose) const
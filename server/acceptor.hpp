@@ -1,8 +1,7 @@
 #pragma once
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
-#include "database.hpp"
-#include "file_handler.hpp"
+#include "session_modules.hpp"
 #include <string>
 
 namespace asio = boost::asio;
@@ -15,7 +14,7 @@ namespace launcher
 		asio::io_context& ioc;
 		asio::ip::tcp::acceptor sock_acceptor;
 		asio::ssl::context ssl_context;
-		std::pair<std::shared_ptr<db::database>, std::shared_ptr<file_handler>>& db_fh;
+		session_modules& modules;
 
 	private:
 		/// <summary>
@@ -33,8 +32,8 @@ namespace launcher
 		/// </summary>
 		/// <param name="ioc_">Reference to executor.</param>
 		/// <param name="port_num">Port number for the socket.</param>
-		/// <param name="db_fh_">Pointer to file handler module object.</param>
-		acceptor(asio::io_context& ioc_, uint16_t port_num, std::pair<std::shared_ptr<db::database>, std::shared_ptr<file_handler>>& db_fh_);
+		/// <param name="modules_">Modules shared by all sessions.</param>
+		acceptor(asio::io_context& ioc_, uint16_t port_num, session_modules& modules_);
 
 		/// <summary>
 		/// Start accepting from all available local addresses.
@@ -0,0 +1,190 @@
+#include "bandwidth_scheduler.hpp"
+#include "common.hpp"
+#include <algorithm>
+
+namespace launcher
+{
+	namespace
+	{
+		// Bucket holds at most 100 ms of traffic, but never less than a few frames.
+		double get_burst(uint64_t rate)
+		{
+			return std::max<double>(rate / 10.0, 4.0 * common::consts::MiB);
+		}
+	}
+
+	void bandwidth_scheduler::token_bucket::refill(clock::time_point now)
+	{
+		if (rate)
+		{
+			std::chrono::duration<double> elapsed = now - refilled;
+			tokens = std::min(tokens + elapsed.count() * rate, get_burst(rate));
+		}
+
+		refilled = now;
+	}
+
+	bandwidth_scheduler::clock::duration bandwidth_scheduler::token_bucket::get_delay() const
+	{
+		if (!rate || tokens > 0)
+		{
+			return clock::duration::zero();
+		}
+
+		// Wait until the bucket has at least one byte.
+		std::chrono::duration<double> delay{ (1 - tokens) / rate };
+		return std::chrono::duration_cast<clock::duration>(delay) + std::chrono::microseconds{ 1 };
+	}
+
+	bandwidth_scheduler::bandwidth_scheduler(asio::io_context& ioc, uint64_t total_rate, uint64_t session_rate_) :
+		session_rate{ session_rate_ }, refill_timer{ ioc }
+	{
+		total.rate = total_rate;
+		total.tokens = total_rate ? get_burst(total_rate) : 0;
+	}
+
+	std::unique_ptr<bandwidth_scheduler::flow> bandwidth_scheduler::open_flow(const asio::any_io_executor& executor)
+	{
+		return std::make_unique<flow>(*this, executor, session_rate);
+	}
+
+	void bandwidth_scheduler::dispatch()
+	{
+		auto now = clock::now();
+		total.refill(now);
+
+		while (active.size())
+		{
+			if (auto delay = total.get_delay(); delay != clock::duration::zero())
+			{
+				arm_timer(delay);
+				return;
+			}
+
+			// Round over the waiting flows. Flows throttled by their own buckets skip the round without a quantum.
+			bool granted = false;
+			auto min_delay = clock::duration::max();
+
+			for (size_t j = active.size(); j && !granted; j--)
+			{
+				auto current = active.front();
+				active.pop_front();
+
+				current->bucket.refill(now);
+
+				if (auto delay = current->bucket.get_delay(); delay != clock::duration::zero())
+				{
+					min_delay = std::min(min_delay, delay);
+					active.push_back(current);
+					continue;
+				}
+
+				current->deficit += quantum;
+
+				if (current->deficit < static_cast<int64_t>(current->pending))
+				{
+					active.push_back(current);
+					continue;
+				}
+
+				// Flow leaves the round with its only frame, an idle flow must not save credit for a burst.
+				current->deficit = 0;
+				current->bucket.tokens -= current->pending;
+				total.tokens -= current->pending;
+				current->granted = true;
+				granted = true;
+
+				// Wake the session on its own executor. Suspended session keeps itself and its flow alive.
+				if (current->waiting)
+				{
+					asio::post(current->permission.get_executor(), [current]() { current->permission.cancel(); });
+				}
+			}
+
+			// Every waiting flow exceeds its own rate.
+			if (!granted && min_delay != clock::duration::max())
+			{
+				arm_timer(min_delay);
+				return;
+			}
+		}
+	}
+
+	void bandwidth_scheduler::arm_timer(clock::duration delay)
+	{
+		if (timer_armed)
+		{
+			return;
+		}
+
+		timer_armed = true;
+		refill_timer.expires_after(delay);
+		refill_timer.async_wait([this](boost::system::error_code e)
+			{
+				if (e)
+				{
+					return;
+				}
+
+				std::lock_guard lock{ scheduler_mutex };
+				timer_armed = false;
+				dispatch();
+			});
+	}
+
+	bandwidth_scheduler::flow::flow(bandwidth_scheduler& scheduler_, const asio::any_io_executor& executor, uint64_t rate) :
+		scheduler{ scheduler_ }, permission{ executor, asio::steady_timer::time_point::max() }
+	{
+		set_rate(rate);
+	}
+
+	bandwidth_scheduler::flow::~flow()
+	{
+		std::lock_guard lock{ scheduler.scheduler_mutex };
+		std::erase(scheduler.active, this);
+	}
+
+	void bandwidth_scheduler::flow::set_rate(uint64_t rate)
+	{
+		std::lock_guard lock{ scheduler.scheduler_mutex };
+
+		bucket.rate = rate;
+		bucket.tokens = rate ? get_burst(rate) : 0;
+		bucket.refilled = clock::now();
+	}
+
+	asio::awaitable<void> bandwidth_scheduler::flow::acquire(uint64_t size)
+	{
+		{
+			std::lock_guard lock{ scheduler.scheduler_mutex };
+
+			// Nothing to share.
+			if (!scheduler.total.rate && !bucket.rate)
+			{
+				co_return;
+			}
+
+			pending = size;
+			granted = false;
+			scheduler.active.push_back(this);
+			scheduler.dispatch();
+		}
+
+		// Permission is posted to the session's executor, so it can't be lost before the wait starts.
+		while (true)
+		{
+			{
+				std::lock_guard lock{ scheduler.scheduler_mutex };
+				waiting = !granted;
+
+				if (granted)
+				{
+					co_return;
+				}
+			}
+
+			boost::system::error_code e;
+			co_await permission.async_wait(asio::redirect_error(asio::use_awaitable, e));
+		}
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <chrono>
+
+namespace asio = boost::asio;
+
+namespace launcher
+{
+	/*
+	* Egress shaping of the update streams. Every session owns a flow and
+	* asks it for permission before writing a frame. Frames are charged
+	* to the flow's own token bucket and to the server's one. When the
+	* server's bucket is empty, waiting flows are served in deficit round
+	* robin order, so sessions get equal shares of the bandwidth no matter
+	* how fast their clients are. Rate 0 means unlimited, without limits
+	* permission is granted at once.
+	*/
+	class bandwidth_scheduler
+	{
+	public:
+		class flow;
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+		// Bytes a flow may send per round, frames larger than it wait for several rounds.
+		static constexpr int64_t quantum = 0x10000;
+
+		struct token_bucket
+		{
+			uint64_t rate = 0; // bytes per second
+			double tokens = 0; // negative after a frame larger than the rest of the bucket
+			clock::time_point refilled = clock::now();
+
+			/// <summary>
+			/// Add tokens for the time since the last refill.
+			/// </summary>
+			/// <param name="now">Current time.</param>
+			void refill(clock::time_point now);
+
+			/// <summary>
+			/// Get time until the bucket has tokens again.
+			/// </summary>
+			/// <returns>Zero if tokens are available.</returns>
+			clock::duration get_delay() const;
+		};
+
+		std::mutex scheduler_mutex;
+		token_bucket total;
+		uint64_t session_rate;
+		std::deque<flow*> active; // flows waiting for permission
+		asio::steady_timer refill_timer;
+		bool timer_armed = false;
+
+	private:
+		/// <summary>
+		/// Grant permissions while tokens are available. Scheduler mutex must be locked.
+		/// </summary>
+		void dispatch();
+
+		/// <summary>
+		/// Dispatch again once tokens are refilled. Scheduler mutex must be locked.
+		/// </summary>
+		/// <param name="delay">Time until tokens are available.</param>
+		void arm_timer(clock::duration delay);
+
+	public:
+		/// <summary>
+		/// Flow of a single session. Only one permission may be awaited at a time.
+		/// </summary>
+		class flow
+		{
+		private:
+			friend class bandwidth_scheduler;
+
+			bandwidth_scheduler& scheduler;
+			token_bucket bucket;
+			int64_t deficit = 0;
+			uint64_t pending = 0; // size of the frame waiting for permission
+			bool granted = false;
+			bool waiting = false; // session is suspended until permission is granted
+			asio::steady_timer permission; // never expires, cancelled when permission is granted
+
+		public:
+			/// <summary>
+			/// Create flow of the session.
+			/// </summary>
+			/// <param name="scheduler_">Scheduler of the server.</param>
+			/// <param name="executor">Executor of the session, waiting coroutines are resumed on it.</param>
+			/// <param name="rate">Bytes per second of the session, 0 is unlimited.</param>
+			flow(bandwidth_scheduler& scheduler_, const asio::any_io_executor& executor, uint64_t rate);
+
+			/// <summary>
+			/// Leave the scheduler.
+			/// </summary>
+			~flow();
+
+			/// <summary>
+			/// Change rate of the session.
+			/// </summary>
+			/// <param name="rate">Bytes per second, 0 is unlimited.</param>
+			void set_rate(uint64_t rate);
+
+			/// <summary>
+			/// Wait for permission to send the frame.
+			/// </summary>
+			/// <param name="size">Size of the frame.</param>
+			asio::awaitable<void> acquire(uint64_t size);
+		};
+
+		/// <summary>
+		/// Create bandwidth scheduler module.
+		/// </summary>
+		/// <param name="ioc">Executor for refill timer.</param>
+		/// <param name="total_rate">Bytes per second of all sessions, 0 is unlimited.</param>
+		/// <param name="session_rate_">Default bytes per second of a session, 0 is unlimited.</param>
+		bandwidth_scheduler(asio::io_context& ioc, uint64_t total_rate, uint64_t session_rate_);
+
+		/// <summary>
+		/// Create flow of a new session with the default rate.
+		/// </summary>
+		/// <param name="executor">Executor of the session.</param>
+		/// <returns>Flow of the session.</returns>
+		std::unique_ptr<flow> open_flow(const asio::any_io_executor& executor);
+	};
+}
@@ -0,0 +1,415 @@
+#include "blake3.hpp"
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+#define force_inline __forceinline
+#elif defined(__GNUC__)
+#define force_inline inline __attribute__((always_inline))
+#else
+#define force_inline inline
+#endif
+
+namespace launcher
+{
+  namespace
+  {
+    constexpr uint32_t chunk_start = 1 << 0;
+    constexpr uint32_t chunk_end = 1 << 1;
+    constexpr uint32_t parent = 1 << 2;
+    constexpr uint32_t root = 1 << 3;
+
+    constexpr blake3_hasher::chaining_value iv = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+    // Number of chunks compressed side by side. Loops over lanes are simple enough for the compiler to vectorize.
+    constexpr uint32_t lanes = 8;
+
+    // Message word order of every round, each round permutes the previous one.
+    constexpr auto message_schedule = []()
+    {
+      constexpr uint8_t permutation[16] = { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 };
+      std::array<std::array<uint8_t, 16>, 7> schedule{};
+
+      for (uint8_t k = 0; k < 16; k++)
+      {
+        schedule[0][k] = k;
+      }
+
+      for (int j = 1; j < 7; j++)
+      {
+        for (int k = 0; k < 16; k++)
+        {
+          schedule[j][k] = schedule[j - 1][permutation[k]];
+        }
+      }
+
+      return schedule;
+    }();
+
+    force_inline uint32_t rotate_right(uint32_t value, int bits)
+    {
+      return (value >> bits) | (value << (32 - bits));
+    }
+
+    force_inline void g(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d, uint32_t mx, uint32_t my)
+    {
+      a = a + b + mx;
+      d = rotate_right(d ^ a, 16);
+      c = c + d;
+      b = rotate_right(b ^ c, 12);
+      a = a + b + my;
+      d = rotate_right(d ^ a, 8);
+      c = c + d;
+      b = rotate_right(b ^ c, 7);
+    }
+
+    /// <summary>
+    /// One round over a single state or over 'lanes' states, where
+    /// every word is an array with the same word of all states.
+    /// </summary>
+    template<typename word, typename message>
+    force_inline void mix(word& a, word& b, word& c, word& d, const message& mx, const message& my)
+    {
+      if constexpr (std::is_same_v<word, uint32_t>)
+      {
+        g(a, b, c, d, mx, my);
+      }
+      else
+      {
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+          g(a[lane], b[lane], c[lane], d[lane], mx[lane], my[lane]);
+        }
+      }
+    }
+
+    template<typename word, typename message>
+    force_inline void round(word* state, const message* m, const std::array<uint8_t, 16>& schedule)
+    {
+      // Columns.
+      mix(state[0], state[4], state[8], state[12], m[schedule[0]], m[schedule[1]]);
+      mix(state[1], state[5], state[9], state[13], m[schedule[2]], m[schedule[3]]);
+      mix(state[2], state[6], state[10], state[14], m[schedule[4]], m[schedule[5]]);
+      mix(state[3], state[7], state[11], state[15], m[schedule[6]], m[schedule[7]]);
+      // Diagonals.
+      mix(state[0], state[5], state[10], state[15], m[schedule[8]], m[schedule[9]]);
+      mix(state[1], state[6], state[11], state[12], m[schedule[10]], m[schedule[11]]);
+      mix(state[2], state[7], state[8], state[13], m[schedule[12]], m[schedule[13]]);
+      mix(state[3], state[4], state[9], state[14], m[schedule[14]], m[schedule[15]]);
+    }
+
+    void compress(const blake3_hasher::chaining_value& cv, const uint32_t block_words[16], uint64_t counter, uint32_t block_len, uint32_t flags, uint32_t out[16])
+    {
+      uint32_t state[16] = { cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        iv[0], iv[1], iv[2], iv[3], static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), block_len, flags };
+
+      for (auto&& schedule : message_schedule)
+      {
+        round(state, block_words, schedule);
+      }
+
+      for (int j = 0; j < 8; j++)
+      {
+        out[j] = state[j] ^ state[j + 8];
+        out[j + 8] = state[j + 8] ^ cv[j];
+      }
+    }
+
+    /// <summary>
+    /// Hash 'lanes' neighbouring full chunks at once.
+    /// </summary>
+    /// <param name="input">Pointer to the first chunk.</param>
+    /// <param name="chunk_counter">Index of the first chunk.</param>
+    /// <param name="out">Chaining values of the chunks.</param>
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+    // Pick AVX2 build of the lanes at runtime when the CPU has it.
+    __attribute__((target_clones("avx2", "default")))
+#endif
+    void hash_chunks(const uint8_t* input, uint64_t chunk_counter, blake3_hasher::chaining_value out[lanes])
+    {
+      uint32_t cv[8][lanes];
+
+      for (int j = 0; j < 8; j++)
+      {
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+          cv[j][lane] = iv[j];
+        }
+      }
+
+      for (uint32_t block = 0; block < blake3_hasher::chunk_size / blake3_hasher::block_size; block++)
+      {
+        uint32_t m[16][lanes];
+        uint32_t state[16][lanes];
+        uint32_t flags = (block == 0 ? chunk_start : 0) | (block == blake3_hasher::chunk_size / blake3_hasher::block_size - 1 ? chunk_end : 0);
+
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+          const uint8_t* block_data = input + lane * blake3_hasher::chunk_size + block * blake3_hasher::block_size;
+
+          for (int j = 0; j < 16; j++)
+          {
+            m[j][lane] = static_cast<uint32_t>(block_data[j * 4]) | static_cast<uint32_t>(block_data[j * 4 + 1]) << 8
+              | static_cast<uint32_t>(block_data[j * 4 + 2]) << 16 | static_cast<uint32_t>(block_data[j * 4 + 3]) << 24;
+          }
+
+          state[12][lane] = static_cast<uint32_t>(chunk_counter + lane);
+          state[13][lane] = static_cast<uint32_t>((chunk_counter + lane) >> 32);
+        }
+
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+          for (int j = 0; j < 8; j++)
+          {
+            state[j][lane] = cv[j][lane];
+          }
+
+          for (int j = 0; j < 4; j++)
+          {
+            state[j + 8][lane] = iv[j];
+          }
+
+          state[14][lane] = blake3_hasher::block_size;
+          state[15][lane] = flags;
+        }
+
+        for (auto&& schedule : message_schedule)
+        {
+          round(state, m, schedule);
+        }
+
+        for (int j = 0; j < 8; j++)
+        {
+          for (uint32_t lane = 0; lane < lanes; lane++)
+          {
+            cv[j][lane] = state[j][lane] ^ state[j + 8][lane];
+          }
+        }
+      }
+
+      for (uint32_t lane = 0; lane < lanes; lane++)
+      {
+        for (int j = 0; j < 8; j++)
+        {
+          out[lane][j] = cv[j][lane];
+        }
+      }
+    }
+
+    void load_words(const uint8_t block[blake3_hasher::block_size], uint32_t words[16])
+    {
+      for (int j = 0; j < 16; j++)
+      {
+        words[j] = static_cast<uint32_t>(block[j * 4]) | static_cast<uint32_t>(block[j * 4 + 1]) << 8
+          | static_cast<uint32_t>(block[j * 4 + 2]) << 16 | static_cast<uint32_t>(block[j * 4 + 3]) << 24;
+      }
+    }
+
+    /// <summary>
+    /// Node of the tree that is not compressed yet. It becomes
+    /// either a chaining value or the root hash.
+    /// </summary>
+    struct output
+    {
+      blake3_hasher::chaining_value input_cv;
+      uint32_t block_words[16];
+      uint64_t counter;
+      uint32_t block_len;
+      uint32_t flags;
+
+      blake3_hasher::chaining_value get_chaining_value() const
+      {
+        uint32_t out[16];
+        compress(input_cv, block_words, counter, block_len, flags, out);
+
+        blake3_hasher::chaining_value cv;
+        std::copy(out, out + 8, cv.begin());
+
+        return cv;
+      }
+
+      std::string get_root_hash() const
+      {
+        uint32_t out[16];
+        compress(input_cv, block_words, 0, block_len, flags | root, out);
+
+        std::string hash;
+        hash.resize(blake3_hasher::digest_size);
+
+        for (uint32_t j = 0; j < blake3_hasher::digest_size / 4; j++)
+        {
+          hash[j * 4] = static_cast<char>(out[j]);
+          hash[j * 4 + 1] = static_cast<char>(out[j] >> 8);
+          hash[j * 4 + 2] = static_cast<char>(out[j] >> 16);
+          hash[j * 4 + 3] = static_cast<char>(out[j] >> 24);
+        }
+
+        return hash;
+      }
+    };
+
+    output parent_output(const blake3_hasher::chaining_value& left, const blake3_hasher::chaining_value& right)
+    {
+      output result{ iv, {}, 0, blake3_hasher::block_size, parent };
+      std::copy(left.begin(), left.end(), result.block_words);
+      std::copy(right.begin(), right.end(), result.block_words + 8);
+
+      return result;
+    }
+  }
+
+  uint32_t blake3_hasher::chunk_state::get_len() const
+  {
+    return blocks_compressed * blake3_hasher::block_size + block_len;
+  }
+
+  blake3_hasher::blake3_hasher(uint64_t input_offset) : first_chunk{ input_offset / chunk_size }
+  {
+    start_chunk(first_chunk);
+  }
+
+  void blake3_hasher::start_chunk(uint64_t chunk_counter)
+  {
+    chunk.cv = iv;
+    chunk.chunk_counter = chunk_counter;
+    chunk.block_len = 0;
+    chunk.blocks_compressed = 0;
+    memset(chunk.block, 0, sizeof(chunk.block));
+  }
+
+  void blake3_hasher::add_chunk_cv(chaining_value cv, uint64_t total_chunks)
+  {
+    // Every trailing zero bit in the number of chunks is a completed subtree to merge.
+    while (!(total_chunks & 1))
+    {
+      cv = merge(cv_stack[--cv_stack_len], cv);
+      total_chunks >>= 1;
+    }
+
+    cv_stack[cv_stack_len++] = cv;
+  }
+
+  void blake3_hasher::update(const void* data, uint64_t size)
+  {
+    auto input = static_cast<const uint8_t*>(data);
+
+    while (size)
+    {
+      // Finish the full chunk only when more input comes, the last chunk must stay for finalization.
+      if (chunk.get_len() == chunk_size)
+      {
+        output chunk_output{ chunk.cv, {}, chunk.chunk_counter, chunk.block_len, chunk_end | (chunk.blocks_compressed ? 0 : chunk_start) };
+        load_words(chunk.block, chunk_output.block_words);
+
+        uint64_t total_chunks = chunk.chunk_counter - first_chunk + 1;
+        add_chunk_cv(chunk_output.get_chaining_value(), total_chunks);
+        start_chunk(chunk.chunk_counter + 1);
+      }
+
+      // Whole chunks are hashed side by side while at least one more byte follows them.
+      while (chunk.get_len() == 0 && size > lanes * chunk_size)
+      {
+        chaining_value cvs[lanes];
+        hash_chunks(input, chunk.chunk_counter, cvs);
+
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+          add_chunk_cv(cvs[lane], chunk.chunk_counter + lane - first_chunk + 1);
+        }
+
+        start_chunk(chunk.chunk_counter + lanes);
+        input += lanes * chunk_size;
+        size -= lanes * chunk_size;
+      }
+
+      // Same for the last block of the chunk.
+      if (chunk.block_len == block_size)
+      {
+        uint32_t block_words[16];
+        load_words(chunk.block, block_words);
+
+        uint32_t out[16];
+        compress(chunk.cv, block_words, chunk.chunk_counter, block_size, chunk.blocks_compressed ? 0 : chunk_start, out);
+        std::copy(out, out + 8, chunk.cv.begin());
+
+        chunk.blocks_compressed++;
+        chunk.block_len = 0;
+        memset(chunk.block, 0, sizeof(chunk.block));
+      }
+
+      uint64_t take = std::min<uint64_t>(block_size - chunk.block_len, size);
+      memcpy(chunk.block + chunk.block_len, input, take);
+
+      chunk.block_len += static_cast<uint8_t>(take);
+      input += take;
+      size -= take;
+    }
+  }
+
+  std::string blake3_hasher::finalize() const
+  {
+    output node{ chunk.cv, {}, chunk.chunk_counter, chunk.block_len, chunk_end | (chunk.blocks_compressed ? 0 : chunk_start) };
+    load_words(chunk.block, node.block_words);
+
+    for (int j = cv_stack_len - 1; j >= 0; j--)
+    {
+      node = parent_output(cv_stack[j], node.get_chaining_value());
+    }
+
+    return node.get_root_hash();
+  }
+
+  blake3_hasher::chaining_value blake3_hasher::finalize_subtree() const
+  {
+    output node{ chunk.cv, {}, chunk.chunk_counter, chunk.block_len, chunk_end | (chunk.blocks_compressed ? 0 : chunk_start) };
+    load_words(chunk.block, node.block_words);
+
+    for (int j = cv_stack_len - 1; j >= 0; j--)
+    {
+      node = parent_output(cv_stack[j], node.get_chaining_value());
+    }
+
+    return node.get_chaining_value();
+  }
+
+  blake3_hasher::chaining_value blake3_hasher::merge(const chaining_value& left, const chaining_value& right)
+  {
+    return parent_output(left, right).get_chaining_value();
+  }
+
+  std::string blake3_hasher::combine_subtrees(const std::vector<chaining_value>& subtrees)
+  {
+    if (subtrees.size() < 2)
+    {
+      throw std::runtime_error{ "at least two subtrees are required" };
+    }
+
+    // The tree is left-balanced: the left child of every node holds the biggest power of two number of parts.
+    auto left_size = [](uint64_t parts)
+    {
+      uint64_t size = 1;
+
+      while (size * 2 < parts)
+      {
+        size *= 2;
+      }
+
+      return size;
+    };
+
+    auto subtree = [&](auto& self, uint64_t first, uint64_t parts) -> chaining_value
+    {
+      if (parts == 1)
+      {
+        return subtrees[first];
+      }
+
+      uint64_t left = left_size(parts);
+      return merge(self(self, first, left), self(self, first + left, parts - left));
+    };
+
+    uint64_t left = left_size(subtrees.size());
+    return parent_output(subtree(subtree, 0, left), subtree(subtree, left, subtrees.size() - left)).get_root_hash();
+  }
+}
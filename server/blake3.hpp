@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <array>
+#include <vector>
+
+namespace launcher
+{
+  /*
+  * Portable BLAKE3 (unkeyed hash mode only). Input is split into 1 KiB
+  * chunks that form a binary tree, so independent parts of a file can be
+  * hashed on different threads: a part that starts at a multiple of a
+  * power of two number of chunks and has that many chunks is a complete
+  * subtree, and its chaining value is merged into the file hash later.
+  */
+  class blake3_hasher
+  {
+  public:
+    static constexpr uint32_t digest_size = 32;
+    static constexpr uint32_t block_size = 64;
+    static constexpr uint32_t chunk_size = 1024;
+
+    using chaining_value = std::array<uint32_t, 8>;
+
+  private:
+    struct chunk_state
+    {
+      chaining_value cv;
+      uint64_t chunk_counter;
+      uint8_t block[block_size];
+      uint8_t block_len;
+      uint8_t blocks_compressed;
+
+      uint32_t get_len() const;
+    };
+
+    chunk_state chunk;
+    uint64_t first_chunk; // non-zero for hashers of a subtree
+    chaining_value cv_stack[54];
+    uint8_t cv_stack_len = 0;
+
+  private:
+    /// <summary>
+    /// Reset chunk state for the chunk with given counter.
+    /// </summary>
+    /// <param name="chunk_counter">Index of the chunk in the whole input.</param>
+    void start_chunk(uint64_t chunk_counter);
+
+    /// <summary>
+    /// Push chaining value of the finished chunk and merge completed subtrees.
+    /// </summary>
+    /// <param name="cv">Chaining value of the chunk.</param>
+    /// <param name="total_chunks">Number of chunks hashed by this hasher.</param>
+    void add_chunk_cv(chaining_value cv, uint64_t total_chunks);
+
+  public:
+    /// <summary>
+    /// Create hasher.
+    /// </summary>
+    /// <param name="input_offset">Offset of the input in the whole data, must be a multiple of chunk_size.
+    /// Non-zero offset makes a hasher of a subtree.</param>
+    blake3_hasher(uint64_t input_offset = 0);
+
+    /// <summary>
+    /// Add input data.
+    /// </summary>
+    /// <param name="data">Pointer to the data.</param>
+    /// <param name="size">Size of the data.</param>
+    void update(const void* data, uint64_t size);
+
+    /// <summary>
+    /// Get the hash of all input.
+    /// </summary>
+    /// <returns>Raw hash of digest_size bytes.</returns>
+    std::string finalize() const;
+
+    /// <summary>
+    /// Get the chaining value of the input as a non-root subtree.
+    /// </summary>
+    /// <returns>Chaining value.</returns>
+    chaining_value finalize_subtree() const;
+
+    /// <summary>
+    /// Merge chaining values of two neighbouring subtrees.
+    /// </summary>
+    /// <param name="left">Left subtree.</param>
+    /// <param name="right">Right subtree.</param>
+    /// <returns>Chaining value of the parent.</returns>
+    static chaining_value merge(const chaining_value& left, const chaining_value& right);
+
+    /// <summary>
+    /// Get the hash of the whole input from the chaining values of its parts.
+    /// All parts except the last one must have the same power of two number of chunks.
+    /// </summary>
+    /// <param name="subtrees">Chaining values of at least two parts in input order.</param>
+    /// <returns>Raw hash of digest_size bytes.</returns>
+    static std::string combine_subtrees(const std::vector<chaining_value>& subtrees);
+  };
+}
@@ -0,0 +1,139 @@
+#include "chunk_cache.hpp"
+#include <iostream>
+
+namespace launcher
+{
+	chunk_cache::chunk_cache(uint64_t capacity_) : capacity{ capacity_ }
+	{}
+
+	std::shared_ptr<const chunk_cache::chunk> chunk_cache::find(const std::string& file_hash, uint64_t offset, uint32_t size)
+	{
+		std::shared_ptr<const chunk> result;
+
+		{
+			std::lock_guard lock{ cache_mutex };
+
+			if (auto it = index.find(key{ file_hash, offset, size }); it != index.end())
+			{
+				auto& entry = slots[it->second];
+				entry.referenced = true;
+				result = entry.value;
+			}
+		}
+
+		// Exactly one lookup sees every multiple of the interval. Hits are counted after
+		// their lookups, so readers that load hits first never see more hits than lookups.
+		uint64_t lookup = lookups.fetch_add(1) + 1;
+
+		if (result != nullptr)
+		{
+			hits++;
+		}
+
+		if (lookup % report_interval == 0)
+		{
+			report();
+		}
+
+		return result;
+	}
+
+	std::shared_ptr<const chunk_cache::chunk> chunk_cache::insert(const std::string& file_hash, uint64_t offset, std::shared_ptr<const chunk> value)
+	{
+		std::lock_guard lock{ cache_mutex };
+
+		key chunk_key{ file_hash, offset, value->raw_size };
+
+		if (auto it = index.find(chunk_key); it != index.end())
+		{
+			return slots[it->second].value;
+		}
+
+		uint64_t size = get_charge(chunk_key, *value);
+
+		if (size > capacity)
+		{
+			return value;
+		}
+
+		make_room(size);
+
+		size_t position;
+
+		if (free_slots.size())
+		{
+			position = free_slots.back();
+			free_slots.pop_back();
+		}
+		else
+		{
+			position = slots.size();
+			slots.emplace_back();
+		}
+
+		// New chunks start without the reference bit, so a single pass of the hand can evict them.
+		slots[position] = slot{ chunk_key, value, false };
+		index.emplace(std::move(chunk_key), position);
+		cached_size += size;
+
+		return value;
+	}
+
+	uint64_t chunk_cache::get_charge(const key& chunk_key, const chunk& value)
+	{
+		// Map node holds the key, the slot index and about four pointers of the tree.
+		// The hash string is stored twice, in the slot and in the index.
+		constexpr uint64_t node_overhead = sizeof(key) + sizeof(size_t) + 4 * sizeof(void*);
+
+		return value.data.size() + 2 * chunk_key.file_hash.size() + sizeof(slot) + sizeof(chunk) + node_overhead;
+	}
+
+	void chunk_cache::make_room(uint64_t size)
+	{
+		while (cached_size + size > capacity && index.size())
+		{
+			if (hand >= slots.size())
+			{
+				hand = 0;
+			}
+
+			auto& entry = slots[hand];
+
+			if (entry.value != nullptr)
+			{
+				if (entry.referenced)
+				{
+					entry.referenced = false;
+				}
+				else
+				{
+					// Sessions that still send the chunk keep their own reference.
+					cached_size -= get_charge(entry.chunk_key, *entry.value);
+					index.erase(entry.chunk_key);
+					entry = slot{};
+					free_slots.push_back(hand);
+				}
+			}
+
+			hand++;
+		}
+	}
+
+	void chunk_cache::report()
+	{
+		auto counters = get_statistics();
+
+		std::cout << "Chunk cache: " << counters.hits << " hits, " << counters.misses << " misses, "
+			<< counters.cached_size / 0x100000 << " MB cached\n";
+	}
+
+	chunk_cache::statistics chunk_cache::get_statistics()
+	{
+		std::lock_guard lock{ cache_mutex };
+
+		// Hits are read before lookups, so misses never underflow.
+		uint64_t hits_number = hits.load();
+
+		return statistics{ hits_number, lookups.load() - hits_number, cached_size };
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace launcher
+{
+	/*
+	* Chunks of files compressed during the transfer, shared by all
+	* sessions. When many launchers download the same files at once every
+	* chunk is compressed by the first session that sends it, the rest
+	* send the same buffer. Raw data doesn't need the cache, sessions send
+	* it from the mapped file, so the page cache already keeps one copy.
+	* Cache is bounded by the size of the stored chunks and evicts them
+	* with the CLOCK policy. Buffers are refcounted, an evicted chunk
+	* stays alive until the last session sending it is done.
+	* Sessions that miss on the same chunk at the same moment compress it
+	* each, the first insert wins. The overlap lasts for one compression of
+	* a chunk, while waiting for another session would need an async wait
+	* across strands in every lookup.
+	*/
+	class chunk_cache
+	{
+	public:
+		struct chunk
+		{
+			std::vector<char> data; // compressed payload, empty if the chunk doesn't shrink
+			uint32_t raw_size;
+		};
+
+		struct statistics
+		{
+			uint64_t hits;
+			uint64_t misses;
+			uint64_t cached_size;
+		};
+
+	private:
+		struct key
+		{
+			std::string file_hash;
+			uint64_t offset;
+			uint32_t size;
+
+			auto operator<=>(const key&) const = default;
+		};
+
+		struct slot
+		{
+			key chunk_key;
+			std::shared_ptr<const chunk> value;
+			bool referenced = false; // second chance of the CLOCK policy
+		};
+
+		static constexpr uint64_t report_interval = 0x1000; // lookups between reports of the counters
+
+		const uint64_t capacity;
+		std::mutex cache_mutex;
+		std::vector<slot> slots;
+		std::vector<size_t> free_slots;
+		std::map<key, size_t> index; // value is index of the slot
+		size_t hand = 0;
+		uint64_t cached_size = 0;
+		std::atomic<uint64_t> lookups = 0;
+		std::atomic<uint64_t> hits = 0; // misses are the rest of the lookups
+
+	private:
+		/// <summary>
+		/// Get size the chunk is charged against the capacity. Besides the data
+		/// it covers the key, the slot and the index node, so chunks that
+		/// don't shrink and are cached without data still count.
+		/// </summary>
+		/// <param name="chunk_key">Key of the chunk.</param>
+		/// <param name="value">Chunk itself.</param>
+		/// <returns>Size in bytes.</returns>
+		static uint64_t get_charge(const key& chunk_key, const chunk& value);
+
+		/// <summary>
+		/// Evict chunks until the new one fits. Cache mutex must be locked.
+		/// </summary>
+		/// <param name="size">Size of the new chunk.</param>
+		void make_room(uint64_t size);
+
+		/// <summary>
+		/// Print counters, called every report_interval lookups.
+		/// </summary>
+		void report();
+
+	public:
+		/// <summary>
+		/// Create chunk cache module.
+		/// </summary>
+		/// <param name="capacity_">Maximum size of the stored chunks in bytes.</param>
+		chunk_cache(uint64_t capacity_ = 0x10000000);
+
+		/// <summary>
+		/// Find compressed chunk of the file.
+		/// </summary>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <param name="offset">Offset of the chunk in the file.</param>
+		/// <param name="size">Size of the raw chunk.</param>
+		/// <returns>Chunk or nullptr on miss.</returns>
+		std::shared_ptr<const chunk> find(const std::string& file_hash, uint64_t offset, uint32_t size);
+
+		/// <summary>
+		/// Put compressed chunk into the cache. If another session has already
+		/// inserted the same chunk, the cached one is kept.
+		/// </summary>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <param name="offset">Offset of the chunk in the file.</param>
+		/// <param name="value">Compressed chunk.</param>
+		/// <returns>Cached chunk.</returns>
+		std::shared_ptr<const chunk> insert(const std::string& file_hash, uint64_t offset, std::shared_ptr<const chunk> value);
+
+		/// <summary>
+		/// Get hit and miss counters.
+		/// </summary>
+		/// <returns>Counters and size of the stored chunks.</returns>
+		statistics get_statistics();
+	};
+}
@@ -0,0 +1,51 @@
+#include "chunk_index.hpp"
+#include "file_view.hpp"
+
+namespace launcher
+{
+	chunk_index::chunk_index(uint32_t number_of_workers) : workers{ number_of_workers }
+	{}
+
+	chunk_index::~chunk_index()
+	{
+		workers.join();
+	}
+
+	asio::awaitable<std::shared_ptr<const chunk_index::chunk_list>> chunk_index::split_file(std::string path)
+	{
+		file_view view{ path };
+		view.check_range(0, view.size());
+		co_return std::make_shared<const chunk_list>(content_chunker::split(view.data(), view.size()));
+	}
+
+	asio::awaitable<std::shared_ptr<const chunk_index::chunk_list>> chunk_index::get_chunks(std::string file_hash, std::string path)
+	{
+		{
+			std::lock_guard lock{ index_mutex };
+
+			if (auto it = indexes.find(file_hash); it != indexes.end())
+			{
+				co_return it->second;
+			}
+		}
+
+		// Don't block the io threads, the caller resumes on its own executor.
+		auto chunks = co_await asio::co_spawn(workers, split_file(std::move(path)), asio::use_awaitable);
+
+		std::lock_guard lock{ index_mutex };
+
+		// Another session could index the same file meanwhile.
+		if (indexes.emplace(file_hash, chunks).second)
+		{
+			insertion_order.push_back(file_hash);
+
+			if (insertion_order.size() > max_cached_files)
+			{
+				indexes.erase(insertion_order.front());
+				insertion_order.pop_front();
+			}
+		}
+
+		co_return chunks;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "content_chunker.hpp"
+
+namespace asio = boost::asio;
+
+namespace launcher
+{
+	/*
+	* Content defined chunks of served files for the delta transfer.
+	* Chunking a large file takes a while, so it runs on a separate
+	* thread pool and the result is kept by file hash: every launcher
+	* asking for the same version of the file reuses the same index.
+	*/
+	class chunk_index
+	{
+	public:
+		using chunk_list = std::vector<content_chunker::chunk>;
+
+	private:
+		static constexpr size_t max_cached_files = 256;
+
+		asio::thread_pool workers;
+		std::mutex index_mutex;
+		// Key is file hash in base64 encoding.
+		std::map<std::string, std::shared_ptr<const chunk_list>> indexes;
+		std::deque<std::string> insertion_order; // oldest indexes are dropped first
+
+	private:
+		/// <summary>
+		/// Map the file and split it into chunks.
+		/// </summary>
+		/// <param name="path">Absolute path to the file.</param>
+		/// <returns>Chunks of the file.</returns>
+		static asio::awaitable<std::shared_ptr<const chunk_list>> split_file(std::string path);
+
+	public:
+		/// <summary>
+		/// Create chunk index module.
+		/// </summary>
+		/// <param name="number_of_workers">Number of threads for chunking.</param>
+		chunk_index(uint32_t number_of_workers = 2);
+
+		/// <summary>
+		/// Stop chunking threads.
+		/// </summary>
+		~chunk_index();
+
+		/// <summary>
+		/// Get chunks of the file, chunk it on the worker threads if it isn't indexed yet.
+		/// </summary>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <param name="path">Absolute path to the file.</param>
+		/// <returns>Chunks of the file.</returns>
+		asio::awaitable<std::shared_ptr<const chunk_list>> get_chunks(std::string file_hash, std::string path);
+	};
+}
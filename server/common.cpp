@@ -1,6 +1,9 @@
 #include "common.hpp"
+#include "merkle_tree.hpp"
 #include <openssl/sha.h>
 #include <boost/beast/core/detail/base64.hpp>
+#include <algorithm>
+#include <string.h>
 
 namespace launcher
 {
@@ -36,28 +39,102 @@ namespace launcher
     return os;
   }
 
-  std::pair<std::string, std::string> messages::request::get_login_pass()
+  std::pair<std::string, std::string> messages::request_view::get_login_pass() const
   {
-    return std::make_pair(request_content[0], request_content[1]);
+    if (request_content.size() < 2)
+    {
+      throw std::runtime_error{ "login or password is missing" };
+    }
+
+    return std::make_pair(std::string{ request_content[0] }, std::string{ request_content[1] });
   }
 
-  std::string& messages::request::get_general_hash()
+  std::string_view messages::request_view::get_general_hash() const
   {
-    return request_content[0];
+    return request_content.size() ? request_content[0] : std::string_view{};
   }
 
-  std::vector<std::pair<std::string, std::string>> messages::request::get_files_hash()
+  std::string_view messages::request_view::get_tree_digest() const
   {
-    std::vector<std::pair<std::string, std::string>> file_list;
+    return request_content.size() > 1 ? request_content[1] : std::string_view{};
+  }
 
-    uint32_t files_num = request_content.size() / 2;
+  std::vector<messages::update_entry> messages::request_view::get_update_entries() const
+  {
+    std::vector<update_entry> entries;
 
-    for (int j = 0; j < files_num; j++)
+    for (auto&& entry : request_content)
     {
-      file_list.emplace_back(std::move(request_content[j * 2]), std::move(request_content[j * 2 + 1]));
+      auto separator = entry.find('\0');
+
+      if (separator == std::string_view::npos)
+      {
+        entries.push_back(update_entry{ std::string{ entry }, 0, {} });
+        continue;
+      }
+
+      update_entry result{ std::string{ entry.substr(0, separator) }, 0, {} };
+
+      if (entry.size() - separator - 1 < sizeof(result.resume_offset))
+      {
+        throw std::runtime_error{ "invalid update entry" };
+      }
+
+      memcpy(&result.resume_offset, entry.data() + separator + 1, sizeof(result.resume_offset));
+      result.local_hashes = std::string{ entry.substr(separator + 1 + sizeof(result.resume_offset)) };
+
+      entries.push_back(std::move(result));
     }
 
-    return file_list;
+    return entries;
+  }
+
+  void messages::request::add_update_entry(const update_entry& entry)
+  {
+    if (!entry.resume_offset && entry.local_hashes.empty())
+    {
+      request_content.push_back(entry.file_name);
+      return;
+    }
+
+    std::string packed = entry.file_name + '\0';
+    packed.append(reinterpret_cast<const char*>(&entry.resume_offset), sizeof(entry.resume_offset));
+    packed += entry.local_hashes;
+
+    request_content.push_back(std::move(packed));
+  }
+
+  std::vector<std::string> messages::request_view::get_hash_algorithms() const
+  {
+    std::vector<std::string> names;
+
+    // Capabilities start with '+'.
+    for (auto&& entry : request_content)
+    {
+      if (!entry.starts_with('+'))
+      {
+        names.emplace_back(entry);
+      }
+    }
+
+    return names;
+  }
+
+  bool messages::request_view::has_capability(std::string_view capability) const
+  {
+    return std::ranges::find(request_content, capability) != request_content.end();
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> messages::request_view::get_merkle_nodes() const
+  {
+    std::vector<std::pair<uint32_t, uint32_t>> nodes;
+
+    for (auto&& node_id : request_content)
+    {
+      nodes.push_back(merkle_tree::parse_node_id(node_id));
+    }
+
+    return nodes;
   }
 
   messages::request::request(request&& obj) : request_id{ obj.request_id }, request_content{ std::move(obj.request_content) }
@@ -149,21 +226,22 @@ namespace launcher
     return response_stream_handler(os, obj);
   }
 
-  uint32_t common::get_stream_size(std::stringstream& ss)
+  std::string common::get_base64_from_sha512(std::string& input)
   {
-    ss.seekg(0, std::ios::end);
-    uint32_t message_size = ss.tellg();
-    ss.seekg(0, std::ios::beg);
+    std::string base64;
+
+    base64.resize(boost::beast::detail::base64::encoded_size(SHA512_DIGEST_LENGTH));
+    boost::beast::detail::base64::encode(base64.data(), input.data(), SHA512_DIGEST_LENGTH);
 
-    return message_size;
+    return base64;
   }
 
-  std::string common::get_base64_from_sha512(std::string& input)
+  std::string common::get_base64(const std::string& input)
   {
     std::string base64;
 
-    base64.resize(common::consts::SHA512_in_base64_size);
-    boost::beast::detail::base64::encode(base64.data(), input.data(), 64);
+    base64.resize(boost::beast::detail::base64::encoded_size(input.size()));
+    boost::beast::detail::base64::encode(base64.data(), input.data(), input.size());
 
     return base64;
   }
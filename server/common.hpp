@@ -10,15 +10,10 @@
 #include <variant>
 #include <regex>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <filesystem>
 
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/archive/text_oarchive.hpp>
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
-#include <boost/serialization/vector.hpp>
-#include <boost/serialization/string.hpp>
-
 namespace asio = boost::asio;
 
 namespace launcher
@@ -32,6 +27,9 @@ namespace launcher
       ping,
       check_general_hash,
       get_update,
+      get_merkle_nodes,
+      get_merkle_buckets,
+      sync, // general hash and digest of the merkle tree, answered with the diff plan or differing nodes
     };
 
     enum class status_codes
@@ -44,22 +42,72 @@ namespace launcher
       fail,
     };
 
+    // How the file is rebuilt by the client, sent in the file frame.
+    enum class transfer_modes : uint8_t
+    {
+      full,
+      delta, // data frames are mixed with copies of chunks of the local file
+      resume, // data frames continue the partial file from the offset reported by the client
+    };
+
+    // File requested in the update request.
+    struct update_entry
+    {
+      std::string file_name;
+      uint64_t resume_offset = 0; // size of the partial copy left by an interrupted transfer, a multiple of 1 MiB
+      std::string local_hashes; // packed chunk hashes of the local copy for the delta transfer
+    };
+
+    // Update stream is written to the socket directly as a sequence of frames without waiting
+    // for the client, encrypted by kernel tls or unencrypted. The client acknowledges received
+    // bytes through the ssl layer.
+    enum class frame_types : uint8_t
+    {
+      end, // no more files, empty payload
+      file, // transfer mode, uint64_t file size and file name, frames of the file follow
+      data, // raw data of the file, at most 1 MiB
+      compressed_data, // uint32_t raw size followed by zstd compressed data
+      copy, // uint32_t first and uint32_t count of local chunks to copy, only in delta mode
+      end_of_file, // empty payload
+    };
+
+    struct frame_header
+    {
+      frame_types type;
+      uint16_t channel; // files are sent on several channels at once, frames of a file carry the channel of its file frame
+      uint32_t size; // size of the payload
+    };
+
+    // Optional protocol features. The client lists them in the ping request
+    // after its hash algorithms, the server repeats the ones it accepts.
+    namespace capabilities
+    {
+      inline const std::string zstd = "+zstd"; // update stream may contain compressed data frames
+      inline const std::string tls_stream = "+tls_stream"; // update stream is sent through tls instead of past it
+      inline const std::string channels = "+channels"; // frames of several files are interleaved in the update stream
+    }
+
+    // First string of the 'hash_miss' answer to the sync request.
+    namespace sync_answers
+    {
+      inline const std::string plan = "plan"; // name and hash of every file changed since the client's release follow
+      inline const std::string nodes = "nodes"; // ids of differing merkle nodes follow, the client walks them with node requests
+    }
+
     struct response
     {
       status_codes status;
       std::string message;
+      std::vector<std::string> response_content;
+    };
 
-      /// <summary>
-      /// Function required by boost for serializing of struct
-      /// fields.
-      /// </summary>
-      /// <param name="ar">Boost archive.</param>
-      /// <param name="version"></param>
-      void serialize(auto& ar, const unsigned int version)
-      {
-        ar& status;
-        ar& message;
-      }
+    // Response decoded in place, strings point into the receive buffer.
+    struct response_view
+    {
+      uint32_t correlation_id; // id of the request
+      status_codes status;
+      std::string_view message;
+      std::vector<std::string_view> response_content;
     };
 
     struct request
@@ -67,66 +115,82 @@ namespace launcher
       messages::request_ids request_id;
       std::vector<std::string> request_content;
 
+      /// <summary>
+      /// Add requested file to the update request.
+      /// </summary>
+      /// <param name="entry">File name, resume offset and chunk hashes of the local copy.</param>
+      void add_update_entry(const update_entry& entry);
+
+      /// <summary>
+      /// Construct request with given or default parameters.
+      /// </summary>
+      /// <param name="request_id_">Enum variable with request number.</param>
+      /// <param name="request_content_">Vector with additional request content.</param>
+      request(messages::request_ids request_id_ = {}, std::vector<std::string> request_content_ = {});
+
+      /// <summary>
+      /// Request move constructor.
+      /// </summary>
+      /// <param name="obj"></param>
+      request(request&& obj);
+    };
+
+    // Request decoded in place, strings point into the receive buffer.
+    struct request_view
+    {
+      uint32_t correlation_id; // chosen by the client, the response repeats it
+      messages::request_ids request_id;
+      std::vector<std::string_view> request_content;
+
       /// <summary>
       /// Extract user's data from request struct.
       /// </summary>
       /// <returns>Pair with login and password.</returns>
-      std::pair<std::string, std::string> get_login_pass();
+      std::pair<std::string, std::string> get_login_pass() const;
 
       /// <summary>
       /// Extract hash of all files from request struct.
       /// </summary>
       /// <returns>Hash in base64 encoding.</returns>
-      std::string& get_general_hash();
+      std::string_view get_general_hash() const;
 
       /// <summary>
-      /// Extract file hash in pairs where first - file name, second
-      /// - file hash in base64 encoding.
+      /// Extract digest of the client's merkle tree from the sync request.
       /// </summary>
-      /// <returns>Vector of pairs with file hash data.</returns>
-      std::vector<std::pair<std::string, std::string>> get_files_hash();
+      /// <returns>Digest made by merkle_tree::get_digest() or empty view.</returns>
+      std::string_view get_tree_digest() const;
 
       /// <summary>
-      /// Construct request with given or default parameters.
+      /// Extract requested files. Every entry is a file name optionally followed by '\0',
+      /// uint64_t resume offset and chunk hashes of the local copy of the file.
       /// </summary>
-      /// <param name="request_id_">Enum variable with request number.</param>
-      /// <param name="request_content_">Vector with additional request content.</param>
-      request(messages::request_ids request_id_ = {}, std::vector<std::string> request_content_ = {});
+      /// <returns>Requested files.</returns>
+      std::vector<update_entry> get_update_entries() const;
 
       /// <summary>
-      /// Request move constructor.
+      /// Extract names of hash algorithms supported by the client.
       /// </summary>
-      /// <param name="obj"></param>
-      request(request&& obj);
+      /// <returns>Vector with names, the preferred one is first.</returns>
+      std::vector<std::string> get_hash_algorithms() const;
+
+      /// <summary>
+      /// Check whether the ping request lists the capability.
+      /// </summary>
+      /// <param name="capability">One of messages::capabilities.</param>
+      /// <returns>True if the client supports it.</returns>
+      bool has_capability(std::string_view capability) const;
 
       /// <summary>
-      /// Function required by boost for serializing of struct
-      /// fields.
+      /// Extract ids of requested merkle tree nodes.
       /// </summary>
-      /// <param name="ar">Boost archive.</param>
-      /// <param name="version"></param>
-      void serialize(auto& ar, const unsigned int version)
-      {
-        ar& request_id;
-        ar& request_content;
-      }
+      /// <returns>Vector of pairs where first - level, second - index.</returns>
+      std::vector<std::pair<uint32_t, uint32_t>> get_merkle_nodes() const;
     };
 
     struct file_list
     {
       // first is file name, second is file size
       std::vector<std::pair<std::string, uint32_t>> files;
-
-      /// <summary>
-      /// Function required by boost for serializing of struct
-      /// fields.
-      /// </summary>
-      /// <param name="ar">Boost archive.</param>
-      /// <param name="version"></param>
-      void serialize(auto& ar, const unsigned int version)
-      {
-        ar& files;
-      }
     };
   }
 
@@ -160,14 +224,6 @@ namespace launcher
 
   namespace common
   {
-
-    /// <summary>
-    /// Get content size of stringstream in bytes.
-    /// </summary>
-    /// <param name="ss">Reference to stream.</param>
-    /// <returns>Number of bytes.</returns>
-    uint32_t get_stream_size(std::stringstream& ss);
-
     namespace regex
     {
       inline std::regex log_pass_regex{ R"([a-zA-Z0-9_\-\/*()\\]+)" };
@@ -176,7 +232,14 @@ namespace launcher
     namespace consts
     {
       inline constinit uint32_t MiB = 0x100000;
-      inline constinit uint32_t SHA512_in_base64_size = 88;
+      inline constinit uint32_t max_message_size = 0x4000000; // 64 MiB, update requests carry chunk hashes of big local files
+      inline constinit uint64_t hash_segment_size = 0x4000000; // 64 MiB, power of two for blake3 subtrees
+      inline constinit uint64_t readahead_size = 0x400000; // 4 MiB
+      inline constinit uint64_t delta_min_file_size = 0x400000; // 4 MiB, smaller files are always sent whole
+      inline constinit uint64_t stream_window_size = 0x2000000; // 32 MiB of unacknowledged update stream, enough for fast links with high latency
+      inline constinit uint64_t stream_ack_interval = 0x400000; // 4 MiB
+      inline constinit uint16_t update_channels = 4; // files sent at once when the launcher supports channels
+      inline constinit uint32_t release_history = 16; // recent manifests the server keeps diff plans from
     }
 
     /// <summary>
@@ -193,6 +256,13 @@ namespace launcher
     /// <returns>Base64 string.</returns>
     std::string get_base64_from_sha512(std::string& input);
 
+    /// <summary>
+    /// Convert raw hash of any length to base64 encoding.
+    /// </summary>
+    /// <param name="input">Raw hash.</param>
+    /// <returns>Base64 string.</returns>
+    std::string get_base64(const std::string& input);
+
     /// <summary>
     /// Get the source directory containing 
     /// the files required for the application.
@@ -0,0 +1,341 @@
+#include "compressed_store.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <set>
+#include <string.h>
+
+namespace launcher
+{
+	namespace
+	{
+		constexpr uint32_t store_magic = 0x54535a4c; // "LZST"
+		constexpr auto poll_interval = std::chrono::milliseconds{ 200 };
+
+		struct block_header
+		{
+			uint32_t stored_size;
+			uint32_t raw_size;
+		};
+
+		void write_value(std::ostream& os, auto value)
+		{
+			os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+	}
+
+	compressed_store::compressed_store(std::shared_ptr<file_handler> fh_ptr_) : fh_ptr{ std::move(fh_ptr_) }, stop{ false }
+	{
+		store_path = fh_ptr->get_folder_name() + ".zstd";
+		std::filesystem::create_directories(store_path);
+
+		worker = std::thread{ [this]() { build_loop(); } };
+	}
+
+	compressed_store::~compressed_store()
+	{
+		stop.store(true);
+
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+	}
+
+	std::shared_ptr<const compressed_store::compressed_file> compressed_store::find(const std::string& file_hash)
+	{
+		std::lock_guard lock{ files_mutex };
+
+		auto it = files.find(file_hash);
+		return it != files.end() ? it->second : nullptr;
+	}
+
+	uint32_t compressed_store::compress_block(ZSTD_CCtx* context, const char* data, uint32_t size, std::vector<char>& output, int level)
+	{
+		output.resize(ZSTD_compressBound(size));
+
+		size_t result = ZSTD_compressCCtx(context, output.data(), output.size(), data, size, level);
+		if (ZSTD_isError(result))
+		{
+			throw std::runtime_error{ ZSTD_getErrorName(result) };
+		}
+
+		// Already compressed assets are sent as is.
+		return result < size ? static_cast<uint32_t>(result) : 0;
+	}
+
+	std::string compressed_store::get_store_name(const std::string& file_hash)
+	{
+		std::string name = file_hash;
+		std::ranges::replace(name, '/', '_');
+		std::ranges::replace(name, '+', '-');
+
+		return name + ".zst";
+	}
+
+	void compressed_store::build_loop()
+	{
+		uint64_t built_version = 0;
+		bool built = false;
+
+		while (!stop.load())
+		{
+			std::map<std::string, std::string> file_list;
+			hash_algorithms algorithm;
+
+			{
+				// Don't keep the manifest pinned while compressing.
+				auto manifest = fh_ptr->get_manifest();
+
+				if (built && manifest->version == built_version)
+				{
+					std::this_thread::sleep_for(poll_interval);
+					continue;
+				}
+
+				for (auto&& [name, file] : manifest->file_list)
+				{
+					file_list.emplace(file.second, file.first);
+				}
+
+				algorithm = manifest->algorithm;
+				built_version = manifest->version;
+				built = true;
+			}
+
+			try
+			{
+				build(file_list, get_hash_algorithm(algorithm));
+			}
+			catch (std::exception& e)
+			{
+				std::cout << "Failed to build compressed store: " << e.what() << '\n';
+			}
+		}
+	}
+
+	void compressed_store::build(const std::map<std::string, std::string>& file_list, const hash_algorithm& algorithm)
+	{
+		uint32_t files_compressed = 0;
+		auto start = std::chrono::steady_clock::now();
+
+		for (auto&& [file_hash, path] : file_list)
+		{
+			if (stop.load())
+			{
+				return;
+			}
+
+			if (find(file_hash) != nullptr)
+			{
+				continue;
+			}
+
+			std::string target_path = (std::filesystem::path{ store_path } / get_store_name(file_hash)).string();
+			std::shared_ptr<const compressed_file> file;
+
+			// Copies survive restarts of the server.
+			if (std::filesystem::exists(target_path))
+			{
+				try
+				{
+					file = load_file(target_path);
+				}
+				catch (std::exception& e)
+				{
+					std::cout << "Rebuilding compressed copy " << target_path << ": " << e.what() << '\n';
+				}
+			}
+
+			if (file == nullptr)
+			{
+				try
+				{
+					// File changed after hashing, the watcher will publish a new manifest soon.
+					if (!compress_file(path, target_path, file_hash, algorithm))
+					{
+						continue;
+					}
+
+					file = load_file(target_path);
+					files_compressed++;
+				}
+				catch (std::exception& e)
+				{
+					std::cout << "Failed to compress " << path << ": " << e.what() << '\n';
+					continue;
+				}
+			}
+
+			std::lock_guard lock{ files_mutex };
+			files.emplace(file_hash, std::move(file));
+		}
+
+		// Forget copies of files that are gone from the manifest.
+		{
+			std::lock_guard lock{ files_mutex };
+			std::erase_if(files, [&](auto&& entry) { return !file_list.contains(entry.first); });
+		}
+
+		std::set<std::string> store_names;
+		for (auto&& [file_hash, path] : file_list)
+		{
+			store_names.insert(get_store_name(file_hash));
+		}
+
+		std::error_code e;
+		for (auto&& entry : std::filesystem::directory_iterator{ store_path, e })
+		{
+			if (!store_names.contains(entry.path().filename().string()))
+			{
+				std::filesystem::remove(entry.path(), e);
+			}
+		}
+
+		if (files_compressed)
+		{
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << "Compressed " << files_compressed << " files into the store in " << elapsed.count() << " s\n";
+		}
+	}
+
+	bool compressed_store::compress_file(const std::string& source_path, const std::string& target_path, const std::string& file_hash, const hash_algorithm& algorithm)
+	{
+		auto stat = manifest_cache::get_file_stat(source_path);
+		file_view view{ source_path };
+		file_hasher hasher{ algorithm };
+
+		uint32_t number_of_blocks = static_cast<uint32_t>((view.size() + common::consts::MiB - 1) / common::consts::MiB);
+		std::vector<block_header> headers(number_of_blocks);
+		std::vector<char> output;
+		compression_context context{ ZSTD_createCCtx() };
+
+		if (context == nullptr)
+		{
+			throw std::runtime_error{ "failed to create compression context" };
+		}
+
+		// Write into temporary file first, so a crash never leaves a half-written copy.
+		std::string temp_path = target_path + ".tmp";
+
+		{
+			std::ofstream stream{ temp_path, std::ios::binary | std::ios::trunc };
+			if (!stream)
+			{
+				throw std::runtime_error{ "failed to create " + temp_path };
+			}
+
+			// Block table is written after the data is compressed.
+			write_value(stream, store_magic);
+			write_value(stream, number_of_blocks);
+			stream.write(reinterpret_cast<const char*>(headers.data()), headers.size() * sizeof(block_header));
+
+			view.will_need(0, common::consts::readahead_size);
+
+			for (uint32_t j = 0; j < number_of_blocks; j++)
+			{
+				if (stop.load())
+				{
+					stream.close();
+					std::filesystem::remove(temp_path);
+					return false;
+				}
+
+				uint64_t offset = static_cast<uint64_t>(j) * common::consts::MiB;
+				uint32_t raw_size = static_cast<uint32_t>(std::min<uint64_t>(view.size() - offset, common::consts::MiB));
+
+				if (offset % common::consts::readahead_size == 0)
+				{
+					view.will_need(offset + common::consts::readahead_size, common::consts::readahead_size);
+				}
+
+				view.check_range(offset, raw_size);
+				hasher.update(view.data() + offset, raw_size);
+
+				uint32_t stored_size = compress_block(context.get(), view.data() + offset, raw_size, output, store_level);
+
+				if (stored_size)
+				{
+					stream.write(output.data(), stored_size);
+				}
+				else
+				{
+					stored_size = raw_size;
+					stream.write(view.data() + offset, raw_size);
+				}
+
+				headers[j] = block_header{ stored_size, raw_size };
+				view.dont_need(offset, raw_size);
+			}
+
+			stream.seekp(sizeof(store_magic) + sizeof(number_of_blocks));
+			stream.write(reinterpret_cast<const char*>(headers.data()), headers.size() * sizeof(block_header));
+
+			if (!stream.flush())
+			{
+				throw std::runtime_error{ "failed to write " + temp_path };
+			}
+		}
+
+		// Data must be the one the manifest was built from and mustn't change while it was read.
+		if (common::get_base64(hasher.finalize()) != file_hash || manifest_cache::get_file_stat(source_path) != stat)
+		{
+			std::filesystem::remove(temp_path);
+			return false;
+		}
+
+		std::filesystem::rename(temp_path, target_path);
+
+		return true;
+	}
+
+	std::shared_ptr<const compressed_store::compressed_file> compressed_store::load_file(const std::string& path)
+	{
+		auto file = std::make_shared<compressed_file>(compressed_file{ file_view{ path }, {} });
+		auto& view = file->view;
+
+		uint32_t magic = 0, number_of_blocks = 0;
+		uint64_t offset = sizeof(magic) + sizeof(number_of_blocks);
+
+		if (view.size() < offset)
+		{
+			throw std::runtime_error{ "damaged compressed copy" };
+		}
+
+		memcpy(&magic, view.data(), sizeof(magic));
+		memcpy(&number_of_blocks, view.data() + sizeof(magic), sizeof(number_of_blocks));
+
+		if (magic != store_magic || view.size() - offset < static_cast<uint64_t>(number_of_blocks) * sizeof(block_header))
+		{
+			throw std::runtime_error{ "damaged compressed copy" };
+		}
+
+		const char* table = view.data() + offset;
+		offset += static_cast<uint64_t>(number_of_blocks) * sizeof(block_header);
+
+		file->blocks.reserve(number_of_blocks);
+
+		for (uint32_t j = 0; j < number_of_blocks; j++)
+		{
+			block_header header;
+			memcpy(&header, table + j * sizeof(block_header), sizeof(header));
+
+			if (header.raw_size == 0 || header.raw_size > common::consts::MiB || header.stored_size > header.raw_size)
+			{
+				throw std::runtime_error{ "damaged compressed copy" };
+			}
+
+			file->blocks.push_back(block{ offset, header.stored_size, header.raw_size });
+			offset += header.stored_size;
+		}
+
+		if (offset != view.size())
+		{
+			throw std::runtime_error{ "damaged compressed copy" };
+		}
+
+		return file;
+	}
+}
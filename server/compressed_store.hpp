@@ -0,0 +1,132 @@
+#pragma once
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <string>
+#include <vector>
+#include <zstd.h>
+#include "file_handler.hpp"
+#include "file_view.hpp"
+#include "hash_algorithm.hpp"
+
+namespace launcher
+{
+	/*
+	* Pre-compressed copies of served files. Every file of the published
+	* manifest is compressed with zstd once, on the store's own thread,
+	* and kept in the '<folder_name>.zstd' directory next to the working
+	* directory under the name derived from the file hash. Files are
+	* compressed in independent blocks of 1 MiB, so a block can be sent
+	* and decompressed as a chunk of the update stream. Copies of files
+	* that are gone from the manifest are deleted.
+	*/
+	class compressed_store
+	{
+	public:
+		struct context_deleter
+		{
+			void operator()(ZSTD_CCtx* context) const
+			{
+				ZSTD_freeCCtx(context);
+			}
+		};
+
+		using compression_context = std::unique_ptr<ZSTD_CCtx, context_deleter>;
+
+		struct block
+		{
+			uint64_t offset; // offset of the stored data in the compressed file
+			uint32_t stored_size; // equals raw_size if the block is stored uncompressed
+			uint32_t raw_size;
+		};
+
+		struct compressed_file
+		{
+			file_view view;
+			std::vector<block> blocks;
+		};
+
+		static constexpr int fast_level = 1; // blocks compressed during the transfer
+		static constexpr int store_level = 12; // copies are built once, so spend more time on them
+
+	private:
+		std::shared_ptr<file_handler> fh_ptr;
+		std::string store_path;
+		std::atomic<bool> stop;
+		std::mutex files_mutex;
+		// Key is file hash in base64 encoding.
+		std::map<std::string, std::shared_ptr<const compressed_file>> files;
+		std::thread worker;
+
+	private:
+		/// <summary>
+		/// Compress files of every new manifest until stopped.
+		/// </summary>
+		void build_loop();
+
+		/// <summary>
+		/// Compress missing files of the manifest and delete copies of removed ones.
+		/// </summary>
+		/// <param name="file_list">Key is file hash, value is an absolute path to the file.</param>
+		/// <param name="algorithm">Algorithm of the file hashes.</param>
+		void build(const std::map<std::string, std::string>& file_list, const hash_algorithm& algorithm);
+
+		/// <summary>
+		/// Compress the file into the store. The data is hashed on the way,
+		/// so a file changed since the manifest was built is never stored
+		/// under the old hash.
+		/// </summary>
+		/// <param name="source_path">Absolute path to the file.</param>
+		/// <param name="target_path">Path to the compressed copy.</param>
+		/// <param name="file_hash">Hash of the file from the manifest in base64 encoding.</param>
+		/// <param name="algorithm">Algorithm of the hash.</param>
+		/// <returns>False if the file differs from the manifest or changed while it was compressed.</returns>
+		bool compress_file(const std::string& source_path, const std::string& target_path, const std::string& file_hash, const hash_algorithm& algorithm);
+
+		/// <summary>
+		/// Map the compressed copy and read its block table.
+		/// </summary>
+		/// <param name="path">Path to the compressed copy.</param>
+		/// <returns>Compressed file.</returns>
+		static std::shared_ptr<const compressed_file> load_file(const std::string& path);
+
+		/// <summary>
+		/// Get file name of the compressed copy. Base64 hash can contain '/'.
+		/// </summary>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <returns>File name inside the store directory.</returns>
+		static std::string get_store_name(const std::string& file_hash);
+
+	public:
+		/// <summary>
+		/// Create the store directory and start compressing files of the file handler.
+		/// </summary>
+		/// <param name="fh_ptr_">Pointer to file handler module.</param>
+		compressed_store(std::shared_ptr<file_handler> fh_ptr_);
+
+		/// <summary>
+		/// Stop the compressing thread.
+		/// </summary>
+		~compressed_store();
+
+		/// <summary>
+		/// Find the compressed copy of the file.
+		/// </summary>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <returns>Compressed file or nullptr if it isn't built yet.</returns>
+		std::shared_ptr<const compressed_file> find(const std::string& file_hash);
+
+		/// <summary>
+		/// Compress one block. Sessions use it with the fast level for files without a compressed copy.
+		/// </summary>
+		/// <param name="context">Compression context of the caller.</param>
+		/// <param name="data">Pointer to the data.</param>
+		/// <param name="size">Size of the data, at most 1 MiB.</param>
+		/// <param name="output">Buffer for the result.</param>
+		/// <param name="level">Zstd compression level.</param>
+		/// <returns>Size of the compressed data or 0 if compression doesn't help.</returns>
+		static uint32_t compress_block(ZSTD_CCtx* context, const char* data, uint32_t size, std::vector<char>& output, int level = fast_level);
+	};
+}
@@ -0,0 +1,109 @@
+#include "content_chunker.hpp"
+#include <openssl/sha.h>
+#include <array>
+#include <algorithm>
+
+namespace launcher
+{
+  namespace
+  {
+    /// <summary>
+    /// Gear table must be the same on both sides, so it's generated
+    /// from a fixed seed instead of a random source.
+    /// </summary>
+    std::array<uint64_t, 256> make_gear_table()
+    {
+      std::array<uint64_t, 256> table;
+      uint64_t state = 0x6c61756e63686572; // splitmix64
+
+      for (auto&& value : table)
+      {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        value = z ^ (z >> 31);
+      }
+
+      return table;
+    }
+
+    const std::array<uint64_t, 256> gear_table = make_gear_table();
+
+    // Normalized chunking: harder mask before the average size, easier after it.
+    constexpr uint64_t mask_small = ~0ull << (64 - 19);
+    constexpr uint64_t mask_large = ~0ull << (64 - 15);
+
+    /// <summary>
+    /// Find the end of the next chunk.
+    /// </summary>
+    /// <param name="data">Start of the chunk.</param>
+    /// <param name="size">Size of remaining data.</param>
+    /// <returns>Length of the chunk.</returns>
+    uint64_t find_boundary(const uint8_t* data, uint64_t size)
+    {
+      if (size <= content_chunker::min_chunk_size)
+      {
+        return size;
+      }
+
+      uint64_t limit = std::min<uint64_t>(size, content_chunker::max_chunk_size);
+      uint64_t normal = std::min<uint64_t>(limit, content_chunker::avg_chunk_size);
+      uint64_t hash = 0;
+      uint64_t j = content_chunker::min_chunk_size;
+
+      for (; j < normal; j++)
+      {
+        hash = (hash << 1) + gear_table[data[j]];
+
+        if (!(hash & mask_small))
+        {
+          return j + 1;
+        }
+      }
+
+      for (; j < limit; j++)
+      {
+        hash = (hash << 1) + gear_table[data[j]];
+
+        if (!(hash & mask_large))
+        {
+          return j + 1;
+        }
+      }
+
+      return limit;
+    }
+  }
+
+  std::vector<content_chunker::chunk> content_chunker::split(const char* data, uint64_t size)
+  {
+    std::vector<chunk> chunks;
+    uint64_t offset = 0;
+
+    while (offset < size)
+    {
+      uint64_t length = find_boundary(reinterpret_cast<const uint8_t*>(data) + offset, size - offset);
+
+      uint8_t hash[SHA512_DIGEST_LENGTH];
+      SHA512(reinterpret_cast<const uint8_t*>(data) + offset, length, hash);
+
+      chunks.push_back({ offset, static_cast<uint32_t>(length), std::string{ reinterpret_cast<char*>(hash), chunk_hash_size } });
+      offset += length;
+    }
+
+    return chunks;
+  }
+
+  std::string content_chunker::pack_hashes(const std::vector<chunk>& chunks)
+  {
+    std::string packed;
+    packed.reserve(chunks.size() * chunk_hash_size);
+
+    for (auto&& current : chunks)
+    {
+      packed += current.hash;
+    }
+
+    return packed;
+  }
+}
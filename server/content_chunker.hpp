@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "common.hpp"
+
+namespace launcher
+{
+  /*
+  * Content defined chunking with a gear rolling hash (FastCDC style).
+  * Chunk boundaries depend only on the bytes around them, so inserting or
+  * removing data in the middle of a file shifts only the chunks near the
+  * change. The server and the launcher chunk their versions of a file the
+  * same way and only chunks missing on the launcher side are transferred.
+  */
+  namespace content_chunker
+  {
+    inline constexpr uint32_t min_chunk_size = 0x8000; // 32 KiB
+    inline constexpr uint32_t avg_chunk_size = 0x20000; // 128 KiB
+    inline constexpr uint32_t max_chunk_size = 0x80000; // 512 KiB
+    inline constexpr uint32_t chunk_hash_size = 16;
+
+    struct chunk
+    {
+      uint64_t offset;
+      uint32_t length;
+      std::string hash; // first chunk_hash_size bytes of raw sha512
+    };
+
+    /// <summary>
+    /// Split data into content defined chunks and hash them.
+    /// </summary>
+    /// <param name="data">Pointer to the data, may be nullptr for empty data.</param>
+    /// <param name="size">Size of the data.</param>
+    /// <returns>Chunks in order of their offsets.</returns>
+    std::vector<chunk> split(const char* data, uint64_t size);
+
+    /// <summary>
+    /// Concatenate chunk hashes for the update request.
+    /// </summary>
+    /// <param name="chunks">Chunks of the local file.</param>
+    /// <returns>String with raw hashes.</returns>
+    std::string pack_hashes(const std::vector<chunk>& chunks);
+  }
+}
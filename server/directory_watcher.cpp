@@ -0,0 +1,186 @@
+#include "directory_watcher.hpp"
+#include <iostream>
+#include <chrono>
+#include <set>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace launcher
+{
+	namespace
+	{
+		// Patches are usually copied file by file, wait for the copy to settle down.
+		constexpr auto quiet_period = std::chrono::milliseconds{ 500 };
+		constexpr int stop_check_interval_ms = 200;
+
+#ifdef __linux__
+		// Files are expected to be closed after writing or moved into the directory.
+		constexpr uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+	}
+
+	directory_watcher::directory_watcher(std::shared_ptr<file_handler> fh_ptr_) : fh_ptr{ std::move(fh_ptr_) }, stop{ false }
+	{
+#ifdef __linux__
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd == -1)
+		{
+			throw std::runtime_error{ "Failed to initialize inotify" };
+		}
+
+		if (!add_watch())
+		{
+			close(inotify_fd);
+			throw std::runtime_error{ ("Failed to watch directory: " + fh_ptr->get_folder_name()).c_str() };
+		}
+
+		worker = std::thread{ [this]() { watch_loop(); } };
+#else
+		std::cout << "Directory watcher is not supported on this platform. Restart the server to publish changes.\n";
+#endif
+	}
+
+	directory_watcher::~directory_watcher()
+	{
+		stop.store(true);
+
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+
+#ifdef __linux__
+		if (inotify_fd != -1)
+		{
+			close(inotify_fd);
+		}
+#endif
+	}
+
+	bool directory_watcher::add_watch()
+	{
+#ifdef __linux__
+		watch_descriptor = inotify_add_watch(inotify_fd, fh_ptr->get_folder_name().c_str(), watch_mask);
+		return watch_descriptor != -1;
+#else
+		return false;
+#endif
+	}
+
+	void directory_watcher::watch_loop()
+	{
+#ifdef __linux__
+		alignas(inotify_event) char events_buf[0x1000];
+		std::set<std::string> changed_files;
+		bool full_rescan = false;
+		bool watch_lost = false;
+		auto last_event_time = std::chrono::steady_clock::now();
+
+		while (!stop.load())
+		{
+			pollfd poll_data{ inotify_fd, POLLIN, 0 };
+			poll(&poll_data, 1, stop_check_interval_ms);
+
+			// Free manifests released by finished transfers.
+			fh_ptr->collect_manifests();
+
+			while (true)
+			{
+				auto length = read(inotify_fd, events_buf, sizeof(events_buf));
+				if (length <= 0)
+				{
+					break;
+				}
+
+				for (char* ptr = events_buf; ptr < events_buf + length; )
+				{
+					auto event = reinterpret_cast<inotify_event*>(ptr);
+					ptr += sizeof(inotify_event) + event->len;
+
+					if (event->mask & IN_Q_OVERFLOW)
+					{
+						// Some events are lost.
+						full_rescan = true;
+					}
+					else if (event->wd != watch_descriptor)
+					{
+						// Leftovers of the watch dropped on the replaced directory.
+						continue;
+					}
+					else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+					{
+						// The directory itself was replaced, e.g. a patch was deployed by rename.
+						if (!watch_lost)
+						{
+							std::cout << "Watched directory was replaced, waiting for " << fh_ptr->get_folder_name() << '\n';
+						}
+
+						watch_lost = true;
+						full_rescan = true;
+					}
+					else if (event->len && !(event->mask & IN_ISDIR))
+					{
+						changed_files.insert(event->name);
+					}
+
+					last_event_time = std::chrono::steady_clock::now();
+				}
+			}
+
+			if (watch_lost)
+			{
+				// A moved directory keeps its watch, drop it before watching the new one.
+				if (watch_descriptor != -1)
+				{
+					inotify_rm_watch(inotify_fd, watch_descriptor);
+				}
+
+				if (!add_watch())
+				{
+					continue;
+				}
+
+				watch_lost = false;
+				last_event_time = std::chrono::steady_clock::now();
+			}
+
+			if ((changed_files.empty() && !full_rescan) || std::chrono::steady_clock::now() - last_event_time < quiet_period)
+			{
+				continue;
+			}
+
+			try
+			{
+				bool published = true;
+
+				if (full_rescan)
+				{
+					fh_ptr->perform_hashing();
+				}
+				else
+				{
+					published = fh_ptr->update_files({ changed_files.begin(), changed_files.end() });
+				}
+
+				if (published)
+				{
+					std::cout << "Published manifest with general hash " << fh_ptr->get_general_hash() << '\n';
+				}
+
+				changed_files.clear();
+				full_rescan = false;
+			}
+			catch (std::exception& e)
+			{
+				// Files may still be copied, keep the batch and retry after the quiet period.
+				std::cout << "Failed to rehash changed files: " << e.what() << '\n';
+				last_event_time = std::chrono::steady_clock::now();
+			}
+		}
+#endif
+	}
+}
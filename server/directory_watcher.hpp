@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <thread>
+#include <atomic>
+#include "file_handler.hpp"
+
+namespace launcher
+{
+	/*
+	* Watches the working directory of the file handler and rehashes
+	* changed files, so a patch can be published without restarting
+	* the server. Events are collected until the directory is quiet
+	* for a moment, then only the affected files are rehashed on the
+	* watcher's own thread and the new manifest is published. Only Linux
+	* (inotify) is supported, on other systems the watcher does nothing.
+	*/
+	class directory_watcher
+	{
+	private:
+		std::shared_ptr<file_handler> fh_ptr;
+		std::atomic<bool> stop;
+		int inotify_fd = -1;
+		int watch_descriptor = -1;
+		std::thread worker;
+
+	private:
+		/// <summary>
+		/// Add inotify watch on the working directory.
+		/// </summary>
+		/// <returns>True if the directory is watched, false if it doesn't exist yet.</returns>
+		bool add_watch();
+
+		/// <summary>
+		/// Read inotify events and rehash changed files until stopped.
+		/// </summary>
+		void watch_loop();
+
+	public:
+		/// <summary>
+		/// Start watching the working directory of the file handler.
+		/// </summary>
+		/// <param name="fh_ptr_">Pointer to file handler module.</param>
+		directory_watcher(std::shared_ptr<file_handler> fh_ptr_);
+
+		/// <summary>
+		/// Stop the watcher thread and release inotify descriptor.
+		/// </summary>
+		~directory_watcher();
+	};
+}
@@ -1,27 +1,46 @@
 #include "file_handler.hpp"
 #include <filesystem>
-#include <openssl/sha.h>
-#include <fstream>
 #include <iostream>
-#include <boost/beast/core/detail/base64.hpp>
 
 namespace launcher
 {
-  file_handler::file_handler(std::string folder_name_) : folder_name{ std::move(folder_name_) }
+  file_handler::file_handler(std::string folder_name_, hash_algorithms algorithm_, uint32_t release_history_) : folder_name{ std::move(folder_name_) }, cache{ folder_name + ".manifest" },
+    algorithm{ algorithm_ }, release_history{ release_history_ }
   {
     std::filesystem::create_directory(folder_name); // create directory if it doesn't exists
-    general_file_hash_base64.resize(SHA512_DIGEST_LENGTH);
     perform_hashing();
   }
 
-  const std::map<std::string, std::pair<std::string, std::string>>& file_handler::get_file_list()
+  void file_handler::set_hash_algorithm(hash_algorithms algorithm_)
   {
-    return file_list;
+    {
+      std::lock_guard lock{ hashing_mutex };
+
+      if (algorithm == algorithm_)
+      {
+        return;
+      }
+
+      algorithm = algorithm_;
+    }
+
+    std::cout << "Switching hash algorithm to " << get_hash_algorithm(algorithm_).get_name() << '\n';
+    perform_hashing();
+  }
+
+  snapshot_domain<manifest>::guard file_handler::get_manifest()
+  {
+    return manifests.pin();
   }
 
-  bool file_handler::compare_general_hash(std::string& hash)
+  void file_handler::collect_manifests()
   {
-    return general_file_hash_base64.compare(hash) ? false : true;
+    manifests.collect();
+  }
+
+  bool file_handler::compare_general_hash(std::string_view hash)
+  {
+    return get_manifest()->general_hash_base64.compare(hash) ? false : true;
   }
 
   std::string file_handler::get_folder_name()
@@ -31,71 +50,200 @@ namespace launcher
 
   std::string file_handler::get_general_hash()
   {
-    return general_file_hash_base64;
+    return get_manifest()->general_hash_base64;
   }
 
   void file_handler::perform_hashing()
   {
+    std::lock_guard lock{ hashing_mutex };
+
+    std::map<std::string, manifest_cache::entry> entries;
+    std::vector<std::filesystem::path> files_to_hash;
+
     for (auto&& dir_entry : std::filesystem::directory_iterator{ folder_name })
     {
       if (dir_entry.is_regular_file())
       {
-        std::string hash;
-        hash.resize(SHA512_DIGEST_LENGTH);
-
-        std::string full_path = std::filesystem::absolute(dir_entry).string();
-        std::string file_name = std::filesystem::path{ full_path }.filename().string();
+        std::string absolute_path = std::filesystem::absolute(dir_entry).string();
+        std::string file_name = dir_entry.path().filename().string();
+        auto stat = manifest_cache::get_file_stat(dir_entry.path());
 
-        uint64_t file_size = std::filesystem::file_size(full_path);
+        auto cached_hash = cache.find(file_name, absolute_path, stat, algorithm);
 
-        std::ifstream file_input{ full_path };
-        if (!file_input)
+        if (cached_hash == nullptr)
         {
-          throw std::runtime_error{ ("failed to open file: " + file_name).c_str() };
+          files_to_hash.push_back(dir_entry.path());
         }
 
-        SHA512_CTX sha512;
-        SHA512_Init(&sha512);
+        entries[file_name] = { std::move(absolute_path), cached_hash ? *cached_hash : std::string{}, stat };
+      }
+    }
 
-        std::vector<uint8_t> file_buffer(common::consts::MiB);
+    if (files_to_hash.size())
+    {
+      for (auto&& file : hasher.hash_files(files_to_hash, get_hash_algorithm(algorithm)))
+      {
+        entries[file.name].hash_base64 = std::move(file.hash_base64);
+      }
+    }
 
-        do
-        {
-          if (file_size < file_buffer.size())
-          {
-            file_buffer.resize(file_size);
-          }
+    publish(std::move(entries), files_to_hash.size());
+  }
 
-          file_input.read(reinterpret_cast<char*>(file_buffer.data()), file_buffer.size());
+  bool file_handler::update_files(const std::vector<std::string>& file_names)
+  {
+    std::lock_guard lock{ hashing_mutex };
 
-          SHA512_Update(&sha512, file_buffer.data(), file_buffer.size());
+    auto entries = cache.get_entries();
+    std::vector<std::filesystem::path> files_to_hash;
+    bool removed = false;
 
-          file_size -= file_buffer.size();
+    for (auto&& file_name : file_names)
+    {
+      auto path = std::filesystem::path{ folder_name } / file_name;
+      std::error_code e;
 
-        } while (file_size);
+      if (!std::filesystem::is_regular_file(path, e))
+      {
+        removed |= entries.erase(file_name) != 0;
+        continue;
+      }
+
+      std::string absolute_path = std::filesystem::absolute(path).string();
+      auto stat = manifest_cache::get_file_stat(path);
+
+      // Event without real changes, e.g. file was opened for writing and closed.
+      if (cache.find(file_name, absolute_path, stat, algorithm))
+      {
+        continue;
+      }
 
-        SHA512_Final(reinterpret_cast<uint8_t*>(hash.data()), &sha512);
+      files_to_hash.push_back(path);
+      entries[file_name] = { std::move(absolute_path), {}, stat };
+    }
 
-        hash = common::get_base64_from_sha512(hash);
+    if (files_to_hash.empty() && !removed)
+    {
+      return false;
+    }
 
-        file_list[file_name] = { full_path, hash };
+    if (files_to_hash.size())
+    {
+      for (auto&& file : hasher.hash_files(files_to_hash, get_hash_algorithm(algorithm)))
+      {
+        entries[file.name].hash_base64 = std::move(file.hash_base64);
       }
     }
 
-    SHA512_CTX sha512;
-    SHA512_Init(&sha512);
+    publish(std::move(entries), files_to_hash.size(), &file_names);
+    return true;
+  }
 
-    for (auto&& file : file_list)
+  void file_handler::set_file_hashes(const std::map<std::string, std::string>& file_hashes)
+  {
+    if (file_hashes.empty())
     {
-      SHA512_Update(&sha512, file.second.second.data(), file.second.second.size());
+      return;
     }
 
-    SHA512_Final(reinterpret_cast<uint8_t*>(general_file_hash_base64.data()), &sha512);
+    std::lock_guard lock{ hashing_mutex };
+
+    auto entries = cache.get_entries();
+    std::vector<std::string> file_names;
 
-    std::string temp;
-    temp.resize(common::consts::SHA512_in_base64_size);
-    boost::beast::detail::base64::encode(temp.data(), general_file_hash_base64.data(), 64);
+    for (auto&& [file_name, hash] : file_hashes)
+    {
+      auto path = std::filesystem::path{ folder_name } / file_name;
+      entries[file_name] = { std::filesystem::absolute(path).string(), hash, manifest_cache::get_file_stat(path) };
+      file_names.push_back(file_name);
+    }
+
+    publish(std::move(entries), file_names.size(), &file_names);
+  }
+
+  void file_handler::publish(std::map<std::string, manifest_cache::entry> entries, uint64_t files_hashed, const std::vector<std::string>* changed_files)
+  {
+    auto new_manifest = std::make_unique<manifest>();
+    new_manifest->version = ++manifest_version;
+    new_manifest->algorithm = algorithm;
+
+    for (auto&& [name, entry] : entries)
+    {
+      new_manifest->file_list[name] = { entry.absolute_path, entry.hash_base64 };
+    }
+
+    auto previous_manifest = manifests.pin();
+
+    if (changed_files && previous_manifest)
+    {
+      // Only paths from changed buckets to the root are recalculated.
+      new_manifest->tree = previous_manifest->tree;
+
+      for (auto&& file_name : *changed_files)
+      {
+        auto it = new_manifest->file_list.find(file_name);
+        new_manifest->tree.set_file(file_name, it == new_manifest->file_list.end() ? nullptr : &it->second.second);
+      }
+    }
+    else
+    {
+      for (auto&& [name, file] : new_manifest->file_list)
+      {
+        new_manifest->tree.set_file(name, &file.second);
+      }
+    }
+
+    previous_manifest.release();
+
+    new_manifest->tree.rehash();
+    new_manifest->general_hash_base64 = new_manifest->tree.get_root_base64();
+
+    // Almost all clients are on one of a few recent releases, their diff plans are computed once here instead of for every client.
+    if (release_history)
+    {
+      std::map<std::string, std::string> file_hashes;
+
+      for (auto&& [name, file] : new_manifest->file_list)
+      {
+        file_hashes.emplace(name, file.second);
+      }
+
+      std::erase_if(releases, [&](auto&& release)
+        {
+          return release.first == new_manifest->general_hash_base64;
+        });
+
+      for (auto&& [general_hash, release_files] : releases)
+      {
+        auto& plan = new_manifest->release_plans[general_hash];
+
+        for (auto&& [name, hash] : file_hashes)
+        {
+          auto it = release_files.find(name);
+
+          if (it == release_files.end() || it->second != hash)
+          {
+            plan.push_back(name);
+            plan.push_back(hash);
+          }
+        }
+      }
+
+      releases.emplace_back(new_manifest->general_hash_base64, std::move(file_hashes));
+
+      if (releases.size() > release_history)
+      {
+        releases.pop_front();
+      }
+    }
+
+    // Removed files change the general hash, touched files are counted in files_hashed.
+    if (files_hashed || new_manifest->general_hash_base64 != cache.get_general_hash() || cache.get_algorithm() != algorithm)
+    {
+      cache.store(std::move(entries), new_manifest->general_hash_base64, algorithm);
+    }
 
-    general_file_hash_base64 = std::move(temp);
+    // Readers that pinned the previous manifest keep using it until they are done.
+    manifests.publish(std::move(new_manifest));
   }
-}
\ No newline at end of file
+}
@@ -2,39 +2,93 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <mutex>
+#include <deque>
 #include <boost/asio.hpp>
 #include <tuple>
 #include "common.hpp"
+#include "hashing_engine.hpp"
+#include "manifest_cache.hpp"
+#include "snapshot_domain.hpp"
+#include "merkle_tree.hpp"
 
 namespace launcher
 {
+  /// <summary>
+  /// Immutable state of the working directory. A new object with
+  /// the next version is published every time the directory changes.
+  /// </summary>
+  struct manifest
+  {
+    uint64_t version;
+    // Key is file name, first in pair is an absolute path, second in pair is a hash in base64 encoding.
+    std::map<std::string, std::pair<std::string, std::string>> file_list;
+    hash_algorithms algorithm; // algorithm of the file hashes
+    merkle_tree tree;
+    std::string general_hash_base64; // root of the tree
+    // Key is general hash of a recent earlier manifest, value is name and hash of every file that differs in this one.
+    std::map<std::string, std::vector<std::string>, std::less<>> release_plans;
+  };
+
   class file_handler
   {
   private:
-    // Key is file name, first in pair is an absolute path, second in pair is a sha512 hash in base64 encoding.
-    std::map<std::string, std::pair<std::string, std::string>> file_list;
     std::string folder_name;
-    std::string general_file_hash_base64;
+    hashing_engine hasher;
+    manifest_cache cache;
+    std::mutex hashing_mutex; // only one rehash at a time
+    hash_algorithms algorithm;
+    uint64_t manifest_version = 0;
+    snapshot_domain<manifest> manifests;
+    uint32_t release_history; // number of recent manifests whose diff plans are precomputed
+    // General hash and file hashes of recent manifests, the newest is the last.
+    std::deque<std::pair<std::string, std::map<std::string, std::string>>> releases;
+
+  private:
+    /// <summary>
+    /// Build manifest from the hashed entries, store it in the cache
+    /// and make it visible to readers.
+    /// </summary>
+    /// <param name="entries">Key is file name.</param>
+    /// <param name="files_hashed">Number of files hashed during this pass.</param>
+    /// <param name="changed_files">If set, only these files are updated in the tree of the previous manifest.</param>
+    void publish(std::map<std::string, manifest_cache::entry> entries, uint64_t files_hashed, const std::vector<std::string>* changed_files = nullptr);
 
   public:
     /// <summary>
-    /// Create file handler module.
+    /// Create file handler module. The hash manifest is cached in
+    /// the '<folder_name_>.manifest' file next to the working directory.
     /// </summary>
     /// <param name="folder_name_">Working directory for the module.</param>
-    file_handler(std::string folder_name_);
+    /// <param name="algorithm_">Hash algorithm for the files.</param>
+    /// <param name="release_history_">Number of recent manifests, clients on them get precomputed diff plans.</param>
+    file_handler(std::string folder_name_, hash_algorithms algorithm_ = hash_algorithms::blake3, uint32_t release_history_ = 0);
+
+    /// <summary>
+    /// Switch hash algorithm and rehash all files if it differs from the current one.
+    /// </summary>
+    /// <param name="algorithm_">Hash algorithm agreed with the server.</param>
+    void set_hash_algorithm(hash_algorithms algorithm_);
 
     /// <summary>
     /// Compare total hash of all files.
     /// </summary>
     /// <param name="hash">Hash in base64 encoding.</param>
     /// <returns>Result of comparison (true \ false).</returns>
-    bool compare_general_hash(std::string& hash);
+    bool compare_general_hash(std::string_view hash);
 
     /// <summary>
-    /// File list getter.
+    /// Pin the current manifest. Lock-free, never waits for a rehash.
+    /// The manifest stays valid and unchanged while the guard is alive,
+    /// even if a new one is published meanwhile.
     /// </summary>
-    /// <returns>The map with all files inside the working directory.</returns>
-    const std::map<std::string, std::pair<std::string, std::string>>& get_file_list();
+    /// <returns>Guard with the current state of the working directory.</returns>
+    snapshot_domain<manifest>::guard get_manifest();
+
+    /// <summary>
+    /// Destroy old manifests that aren't pinned anymore.
+    /// </summary>
+    void collect_manifests();
 
     /// <summary>
     /// Working folder getter.
@@ -50,7 +104,25 @@ namespace launcher
 
     /// <summary>
     /// Perform hashing of files in working directory.
+    /// Files are hashed in parallel by the hashing engine. Only files
+    /// whose size, modification time or inode differ from the cached
+    /// manifest are rehashed.
     /// </summary>
     void perform_hashing();
+
+    /// <summary>
+    /// Rehash only the given files and publish the new manifest.
+    /// Files that don't exist anymore are removed from the manifest.
+    /// </summary>
+    /// <param name="file_names">Names of changed files inside the working directory.</param>
+    /// <returns>False if the files didn't actually change and nothing was published.</returns>
+    bool update_files(const std::vector<std::string>& file_names);
+
+    /// <summary>
+    /// Publish files whose hashes are already known, e.g. files verified
+    /// while they were downloaded. Files aren't read again.
+    /// </summary>
+    /// <param name="file_hashes">Key is file name inside the working directory, value is its hash in base64 encoding.</param>
+    void set_file_hashes(const std::map<std::string, std::string>& file_hashes);
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,390 @@
+#include "file_reader.hpp"
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+#endif
+
+namespace launcher
+{
+	struct file_reader::read_request
+	{
+		int fd = -1;
+		uint64_t offset = 0;
+		uint32_t size = 0;
+		char* output = nullptr;
+
+		virtual void complete(int64_t result) = 0;
+		virtual ~read_request() = default;
+	};
+
+	template<typename Handler>
+	struct file_reader::handler_request final : file_reader::read_request
+	{
+		Handler handler;
+
+		handler_request(Handler&& handler_) : handler{ std::move(handler_) }
+		{}
+
+		void complete(int64_t result) override
+		{
+			// Resume the caller on its own executor.
+			auto executor = asio::get_associated_executor(handler);
+			asio::post(executor, [handler = std::move(handler), result]() mutable { handler(result); });
+		}
+	};
+
+	file_reader::file_reader(asio::io_context& ioc_, uint32_t number_of_workers) : ioc{ ioc_ }, workers{ number_of_workers },
+		discard_buffer{ std::make_unique<char[]>(discard_buffer_size) }
+	{
+		if (!setup_ring())
+		{
+			std::cout << "io_uring isn't available, files are read on the thread pool\n";
+		}
+	}
+
+	file_reader::~file_reader()
+	{
+		{
+			std::lock_guard lock{ submit_mutex };
+			stopped = true;
+		}
+
+		close_ring();
+		workers.join();
+	}
+
+	bool file_reader::setup_ring()
+	{
+#ifdef __linux__
+		io_uring_params params{};
+
+		uring.fd = static_cast<int>(syscall(__NR_io_uring_setup, ring_entries, &params));
+		if (uring.fd < 0)
+		{
+			uring.fd = -1;
+			return false;
+		}
+
+		uring.sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		uring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		// Both rings share one mapping on newer kernels.
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			uring.sq_size = uring.cq_size = std::max(uring.sq_size, uring.cq_size);
+		}
+
+		auto map_ring = [this](size_t size, uint64_t offset) -> void*
+		{
+			void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, offset);
+			return ptr == MAP_FAILED ? nullptr : ptr;
+		};
+
+		uring.sq_ptr = map_ring(uring.sq_size, IORING_OFF_SQ_RING);
+		uring.cq_ptr = params.features & IORING_FEAT_SINGLE_MMAP ? uring.sq_ptr : map_ring(uring.cq_size, IORING_OFF_CQ_RING);
+		uring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		uring.sqes_ptr = map_ring(uring.sqes_size, IORING_OFF_SQES);
+
+		if (uring.sq_ptr == nullptr || uring.cq_ptr == nullptr || uring.sqes_ptr == nullptr)
+		{
+			close_ring();
+			return false;
+		}
+
+		auto sq = static_cast<char*>(uring.sq_ptr);
+		auto cq = static_cast<char*>(uring.cq_ptr);
+
+		uring.sq_head = reinterpret_cast<std::atomic<uint32_t>*>(sq + params.sq_off.head);
+		uring.sq_tail = reinterpret_cast<std::atomic<uint32_t>*>(sq + params.sq_off.tail);
+		uring.sq_mask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+		uring.sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+		uring.cq_head = reinterpret_cast<std::atomic<uint32_t>*>(cq + params.cq_off.head);
+		uring.cq_tail = reinterpret_cast<std::atomic<uint32_t>*>(cq + params.cq_off.tail);
+		uring.cq_mask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+		uring.cqes = cq + params.cq_off.cqes;
+		uring.cq_entries = params.cq_entries;
+
+		// Kernel signals the eventfd on every completion.
+		int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		if (event_fd == -1 || syscall(__NR_io_uring_register, uring.fd, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0)
+		{
+			if (event_fd != -1)
+			{
+				close(event_fd);
+			}
+
+			close_ring();
+			return false;
+		}
+
+		completion_event = std::make_unique<asio::posix::stream_descriptor>(ioc, event_fd);
+		wait_completions();
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void file_reader::close_ring()
+	{
+#ifdef __linux__
+		if (completion_event != nullptr)
+		{
+			boost::system::error_code e;
+			completion_event->close(e);
+		}
+
+		if (uring.sqes_ptr != nullptr)
+		{
+			munmap(uring.sqes_ptr, uring.sqes_size);
+		}
+
+		if (uring.cq_ptr != nullptr && uring.cq_ptr != uring.sq_ptr)
+		{
+			munmap(uring.cq_ptr, uring.cq_size);
+		}
+
+		if (uring.sq_ptr != nullptr)
+		{
+			munmap(uring.sq_ptr, uring.sq_size);
+		}
+
+		if (uring.fd != -1)
+		{
+			close(uring.fd);
+		}
+#endif
+
+		uring = ring{};
+	}
+
+	bool file_reader::submit(read_request* request)
+	{
+#ifdef __linux__
+		std::lock_guard lock{ submit_mutex };
+
+		// Completion queue must never overflow.
+		if (stopped || in_flight.load() >= uring.cq_entries)
+		{
+			return false;
+		}
+
+		uint32_t tail = uring.sq_tail->load(std::memory_order_relaxed);
+		uint32_t index = tail & uring.sq_mask;
+
+		if (tail - uring.sq_head->load(std::memory_order_acquire) > uring.sq_mask)
+		{
+			return false;
+		}
+
+		auto sqe = static_cast<io_uring_sqe*>(uring.sqes_ptr) + index;
+		memset(sqe, 0, sizeof(*sqe));
+
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = request->fd;
+		sqe->off = request->offset;
+		sqe->addr = reinterpret_cast<uint64_t>(request->output);
+		sqe->len = request->size;
+		sqe->user_data = reinterpret_cast<uint64_t>(request);
+
+		uring.sq_array[index] = index;
+		uring.sq_tail->store(tail + 1, std::memory_order_release);
+		in_flight++;
+
+		while (syscall(__NR_io_uring_enter, uring.fd, 1, 0, 0, nullptr, 0) < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+			{
+				continue;
+			}
+
+			// Nothing would ever flush the entry, take it back unless the kernel has consumed it.
+			// The request falls back to the blocking read, which reports the real error.
+			if (uring.sq_head->load(std::memory_order_acquire) == tail)
+			{
+				uring.sq_tail->store(tail, std::memory_order_release);
+				in_flight--;
+				return false;
+			}
+
+			break;
+		}
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void file_reader::wait_completions()
+	{
+#ifdef __linux__
+		completion_event->async_wait(asio::posix::stream_descriptor::wait_read, [this](boost::system::error_code e)
+			{
+				// Reader is destroyed.
+				if (e)
+				{
+					return;
+				}
+
+				uint64_t counter;
+				[[maybe_unused]] auto result = ::read(completion_event->native_handle(), &counter, sizeof(counter));
+
+				// Only this handler consumes completions, one wait is outstanding at a time.
+				uint32_t head = uring.cq_head->load(std::memory_order_relaxed);
+				uint32_t tail = uring.cq_tail->load(std::memory_order_acquire);
+
+				for (; head != tail; head++)
+				{
+					auto cqe = static_cast<io_uring_cqe*>(uring.cqes) + (head & uring.cq_mask);
+					auto request = reinterpret_cast<read_request*>(cqe->user_data);
+					int64_t res = cqe->res;
+
+					uring.cq_head->store(head + 1, std::memory_order_release);
+					in_flight--;
+
+					request->complete(res);
+					delete request;
+				}
+
+				wait_completions();
+			});
+#endif
+	}
+
+	asio::awaitable<int64_t> file_reader::read_blocking(int fd, uint64_t offset, uint32_t size, char* output)
+	{
+#ifdef __linux__
+		int64_t result;
+
+		do
+		{
+			result = pread(fd, output, size, offset);
+		} while (result < 0 && errno == EINTR);
+
+		co_return result < 0 ? -errno : result;
+#else
+		co_return -1;
+#endif
+	}
+
+	asio::awaitable<uint64_t> file_reader::read(int fd, uint64_t offset, uint32_t size, char* output)
+	{
+		uint64_t total = 0;
+
+		while (total < size)
+		{
+			int64_t result = -1;
+			bool submitted = false;
+
+			if (uring.fd != -1)
+			{
+				result = co_await asio::async_initiate<const asio::use_awaitable_t<>&, void(int64_t)>(
+					[this, fd, offset, size, output, total, &submitted](auto handler)
+					{
+						auto request = new handler_request<decltype(handler)>{ std::move(handler) };
+						request->fd = fd;
+						request->offset = offset + total;
+						request->size = size - static_cast<uint32_t>(total);
+						request->output = output + total;
+
+						submitted = submit(request);
+
+						if (!submitted)
+						{
+							request->complete(-1);
+							delete request;
+						}
+					}, asio::use_awaitable);
+			}
+
+			// Queue is full or the kernel doesn't support the operation, the pool reports the real error.
+			if (!submitted || result < 0)
+			{
+				result = co_await asio::co_spawn(workers, read_blocking(fd, offset + total, size - static_cast<uint32_t>(total), output + total), asio::use_awaitable);
+			}
+
+			if (result < 0)
+			{
+				throw std::runtime_error{ std::string{ "failed to read file: " } + strerror(static_cast<int>(-result)) };
+			}
+
+			// End of file.
+			if (result == 0)
+			{
+				break;
+			}
+
+			total += result;
+		}
+
+		co_return total;
+	}
+
+	asio::awaitable<void> file_reader::make_resident(const file_view& view, uint64_t offset, uint32_t size)
+	{
+#ifdef __linux__
+		static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+		if (!size || offset + size > view.size())
+		{
+			co_return;
+		}
+
+		// Range is checked window by window, so nothing is allocated per call. Pages are at least 4 KiB.
+		for (uint64_t window = offset; window < offset + size; window += discard_buffer_size)
+		{
+			uint64_t window_end = std::min<uint64_t>(offset + size, window + discard_buffer_size);
+			uint64_t first_page = window / page_size;
+			uint64_t pages = (window_end - 1) / page_size - first_page + 1;
+			std::array<unsigned char, discard_buffer_size / 0x1000 + 2> residency;
+
+			if (pages > residency.size() || mincore(const_cast<char*>(view.data()) + first_page * page_size, pages * page_size, residency.data()))
+			{
+				co_return;
+			}
+
+			// Read everything from the first missing page to the last one.
+			auto resident = [](unsigned char page) { return page & 1; };
+			auto residency_end = residency.begin() + pages;
+			auto first_missing = std::find_if_not(residency.begin(), residency_end, resident);
+
+			if (first_missing == residency_end)
+			{
+				continue;
+			}
+
+			auto last_missing = std::find_if_not(std::make_reverse_iterator(residency_end), residency.rend(), resident);
+
+			uint64_t begin = std::max(window, (first_page + (first_missing - residency.begin())) * page_size);
+			uint64_t end = std::min(window_end, (first_page + (residency.rend() - last_missing)) * page_size);
+
+			// Data itself isn't needed, concurrent reads may overwrite each other in the shared buffer.
+			co_await read(view.native_handle(), begin, static_cast<uint32_t>(end - begin), discard_buffer.get());
+		}
+#endif
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "file_view.hpp"
+
+namespace asio = boost::asio;
+
+namespace launcher
+{
+	/*
+	* Asynchronous file reads for the serving coroutines. Sessions send
+	* files from the mapping and with sendfile, both block the io thread
+	* on a cold page cache. Before a range is touched the session checks
+	* its residency with mincore and, if some pages are missing, reads
+	* them with io_uring, so the page cache is warm when the data is sent.
+	* Completions are delivered through an eventfd registered in the
+	* io_context. If io_uring isn't available reads run on a small thread
+	* pool. On other systems than Linux ranges are never read in advance.
+	*/
+	class file_reader
+	{
+	private:
+		struct read_request;
+
+		template<typename Handler>
+		struct handler_request;
+
+		// Mapped io_uring rings.
+		struct ring
+		{
+			int fd = -1;
+			void* sq_ptr = nullptr;
+			size_t sq_size = 0;
+			void* cq_ptr = nullptr;
+			size_t cq_size = 0;
+			void* sqes_ptr = nullptr;
+			size_t sqes_size = 0;
+
+			std::atomic<uint32_t>* sq_head = nullptr;
+			std::atomic<uint32_t>* sq_tail = nullptr;
+			uint32_t sq_mask = 0;
+			uint32_t* sq_array = nullptr;
+			std::atomic<uint32_t>* cq_head = nullptr;
+			std::atomic<uint32_t>* cq_tail = nullptr;
+			uint32_t cq_mask = 0;
+			void* cqes = nullptr;
+			uint32_t cq_entries = 0;
+		};
+
+		static constexpr uint32_t ring_entries = 256;
+		static constexpr uint32_t discard_buffer_size = 0x100000; // ranges are made resident in windows of this size
+
+		asio::io_context& ioc;
+		asio::thread_pool workers;
+		ring uring;
+#ifdef __linux__
+		std::unique_ptr<asio::posix::stream_descriptor> completion_event;
+#endif
+		std::mutex submit_mutex;
+		std::atomic<uint32_t> in_flight = 0;
+		bool stopped = false;
+		// Target of reads that only warm the page cache. Shared by all of them, the data is never looked at.
+		std::unique_ptr<char[]> discard_buffer;
+
+	private:
+		/// <summary>
+		/// Create io_uring and register the completion eventfd.
+		/// </summary>
+		/// <returns>False if io_uring isn't available.</returns>
+		bool setup_ring();
+
+		/// <summary>
+		/// Unmap rings and close descriptors.
+		/// </summary>
+		void close_ring();
+
+		/// <summary>
+		/// Put read request into the submission queue.
+		/// </summary>
+		/// <param name="request">Request, owned by the ring until its completion.</param>
+		/// <returns>False if the queue is full.</returns>
+		bool submit(read_request* request);
+
+		/// <summary>
+		/// Wait for the eventfd and complete finished requests.
+		/// </summary>
+		void wait_completions();
+
+		/// <summary>
+		/// Read the range on the thread pool.
+		/// </summary>
+		/// <param name="fd">File descriptor.</param>
+		/// <param name="offset">Offset of the range.</param>
+		/// <param name="size">Size of the range.</param>
+		/// <param name="output">Output buffer.</param>
+		static asio::awaitable<int64_t> read_blocking(int fd, uint64_t offset, uint32_t size, char* output);
+
+	public:
+		/// <summary>
+		/// Create file reader module.
+		/// </summary>
+		/// <param name="ioc_">Executor of the sessions, completions are delivered through it.</param>
+		/// <param name="number_of_workers">Number of threads for reads without io_uring.</param>
+		file_reader(asio::io_context& ioc_, uint32_t number_of_workers = 2);
+
+		/// <summary>
+		/// Release io_uring and stop reading threads.
+		/// </summary>
+		~file_reader();
+
+		/// <summary>
+		/// Read the range of the file without blocking the caller's thread.
+		/// </summary>
+		/// <param name="fd">File descriptor.</param>
+		/// <param name="offset">Offset of the range.</param>
+		/// <param name="size">Size of the range.</param>
+		/// <param name="output">Output buffer, it must stay alive until the read completes.</param>
+		/// <returns>Number of bytes read.</returns>
+		asio::awaitable<uint64_t> read(int fd, uint64_t offset, uint32_t size, char* output);
+
+		/// <summary>
+		/// Make sure the range of the mapped file is in the page cache,
+		/// pages that are missing are read asynchronously.
+		/// </summary>
+		/// <param name="view">Mapped file.</param>
+		/// <param name="offset">Offset of the range.</param>
+		/// <param name="size">Size of the range.</param>
+		asio::awaitable<void> make_resident(const file_view& view, uint64_t offset, uint32_t size);
+	};
+}
@@ -0,0 +1,238 @@
+#include "file_view.hpp"
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace launcher
+{
+  namespace
+  {
+    /// <summary>
+    /// Align the range to page boundaries as madvise requires.
+    /// </summary>
+    /// <param name="offset">Offset of the range. Aligned down.</param>
+    /// <param name="length">Length of the range. Extended by the alignment.</param>
+    /// <param name="file_size">Range is clamped by the file size.</param>
+    /// <returns>False if the range is empty.</returns>
+    bool align_range(uint64_t& offset, uint64_t& length, uint64_t file_size)
+    {
+      constexpr uint64_t page_size = 0x1000;
+
+      if (offset >= file_size)
+      {
+        return false;
+      }
+
+      length = std::min(length, file_size - offset);
+      length += offset % page_size;
+      offset -= offset % page_size;
+
+      return length != 0;
+    }
+  }
+
+  file_view::file_view(const std::string& path)
+  {
+    auto file_name = std::filesystem::path{ path }.filename().string();
+
+#ifdef _WIN32
+    file_handle = CreateFileW(std::filesystem::path{ path }.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+      file_handle = nullptr;
+      throw std::runtime_error{ ("failed to open file: " + file_name).c_str() };
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_handle, &size))
+    {
+      close();
+      throw std::runtime_error{ ("failed to get size of file: " + file_name).c_str() };
+    }
+
+    file_size = size.QuadPart;
+
+    // Empty files can't be mapped.
+    if (file_size)
+    {
+      mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      mapped_data = mapping_handle ? static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+      if (mapped_data == nullptr)
+      {
+        close();
+        throw std::runtime_error{ ("failed to map file: " + file_name).c_str() };
+      }
+    }
+#else
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      throw std::runtime_error{ ("failed to open file: " + file_name).c_str() };
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info))
+    {
+      close();
+      throw std::runtime_error{ ("failed to get size of file: " + file_name).c_str() };
+    }
+
+    file_size = info.st_size;
+
+    // Empty files can't be mapped.
+    if (file_size)
+    {
+      void* mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED)
+      {
+        close();
+        throw std::runtime_error{ ("failed to map file: " + file_name).c_str() };
+      }
+
+      mapped_data = static_cast<const char*>(mapping);
+      ::madvise(mapping, file_size, MADV_SEQUENTIAL);
+    }
+#endif
+  }
+
+  file_view::file_view(file_view&& obj) noexcept
+  {
+    *this = std::move(obj);
+  }
+
+  file_view& file_view::operator=(file_view&& obj) noexcept
+  {
+    if (this != &obj)
+    {
+      close();
+
+#ifdef _WIN32
+      file_handle = std::exchange(obj.file_handle, nullptr);
+      mapping_handle = std::exchange(obj.mapping_handle, nullptr);
+#else
+      fd = std::exchange(obj.fd, -1);
+#endif
+      mapped_data = std::exchange(obj.mapped_data, nullptr);
+      file_size = std::exchange(obj.file_size, 0);
+    }
+
+    return *this;
+  }
+
+  file_view::~file_view()
+  {
+    close();
+  }
+
+  void file_view::close()
+  {
+#ifdef _WIN32
+    if (mapped_data)
+    {
+      UnmapViewOfFile(mapped_data);
+    }
+
+    if (mapping_handle)
+    {
+      CloseHandle(mapping_handle);
+    }
+
+    if (file_handle)
+    {
+      CloseHandle(file_handle);
+    }
+
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (mapped_data)
+    {
+      ::munmap(const_cast<char*>(mapped_data), file_size);
+    }
+
+    if (fd != -1)
+    {
+      ::close(fd);
+    }
+
+    fd = -1;
+#endif
+
+    mapped_data = nullptr;
+    file_size = 0;
+  }
+
+  const char* file_view::data() const
+  {
+    return mapped_data;
+  }
+
+#ifndef _WIN32
+  int file_view::native_handle() const
+  {
+    return fd;
+  }
+#endif
+
+  uint64_t file_view::size() const
+  {
+    return file_size;
+  }
+
+  void file_view::check_range(uint64_t offset, uint64_t length) const
+  {
+    if (offset + length > file_size)
+    {
+      throw std::runtime_error{ "range is out of the mapped file" };
+    }
+
+#ifndef _WIN32
+    struct stat info;
+    if (length && (::fstat(fd, &info) || static_cast<uint64_t>(info.st_size) < offset + length))
+    {
+      throw std::runtime_error{ "mapped file was truncated" };
+    }
+#endif
+  }
+
+  void file_view::will_need(uint64_t offset, uint64_t length) const
+  {
+    if (!align_range(offset, length, file_size))
+    {
+      return;
+    }
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(mapped_data) + offset, static_cast<SIZE_T>(length) };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    ::madvise(const_cast<char*>(mapped_data) + offset, length, MADV_WILLNEED);
+#endif
+  }
+
+  void file_view::dont_need(uint64_t offset, uint64_t length) const
+  {
+#ifndef _WIN32
+    if (!align_range(offset, length, file_size))
+    {
+      return;
+    }
+
+    ::madvise(const_cast<char*>(mapped_data) + offset, length, MADV_DONTNEED);
+#endif
+  }
+}
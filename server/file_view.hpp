@@ -0,0 +1,105 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+namespace launcher
+{
+  /*
+  * Read-only memory mapped file. Hashing and file transfer read directly
+  * from the mapping, so the data comes straight from the page cache without
+  * intermediate buffers. The mapping is advised for sequential access and
+  * callers can request readahead of the next window and release pages they
+  * have already consumed.
+  *
+  * Touching pages past the end of a file truncated after mapping raises
+  * SIGBUS on Linux, so files must be published by rename rather than
+  * overwritten in place, and readers call check_range() right before they
+  * access the data to catch files that were overwritten anyway. Windows
+  * doesn't allow to truncate a mapped file.
+  */
+  class file_view
+  {
+  private:
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+    const char* mapped_data = nullptr;
+    uint64_t file_size = 0;
+
+  private:
+    /// <summary>
+    /// Unmap the file and close handles.
+    /// </summary>
+    void close();
+
+  public:
+    /// <summary>
+    /// Map the whole file into memory.
+    /// </summary>
+    /// <param name="path">Path to the file.</param>
+    file_view(const std::string& path);
+
+    file_view(const file_view&) = delete;
+    file_view& operator=(const file_view&) = delete;
+
+    /// <summary>
+    /// File view move constructor.
+    /// </summary>
+    /// <param name="obj"></param>
+    file_view(file_view&& obj) noexcept;
+
+    /// <summary>
+    /// File view move assignment.
+    /// </summary>
+    /// <param name="obj"></param>
+    /// <returns></returns>
+    file_view& operator=(file_view&& obj) noexcept;
+
+    ~file_view();
+
+    /// <summary>
+    /// Mapped data getter. Returns nullptr for empty files.
+    /// </summary>
+    /// <returns>Pointer to the first byte of the file.</returns>
+    const char* data() const;
+
+#ifndef _WIN32
+    /// <summary>
+    /// File descriptor getter, the file can be sent to a socket without mapping.
+    /// </summary>
+    /// <returns>Descriptor of the file.</returns>
+    int native_handle() const;
+#endif
+
+    /// <summary>
+    /// File size getter.
+    /// </summary>
+    /// <returns>Size of the file in bytes.</returns>
+    uint64_t size() const;
+
+    /// <summary>
+    /// Make sure the range is still backed by the file. Throws if the file was truncated.
+    /// </summary>
+    /// <param name="offset">Offset of the range.</param>
+    /// <param name="length">Length of the range.</param>
+    void check_range(uint64_t offset, uint64_t length) const;
+
+    /// <summary>
+    /// Ask the kernel to start reading the range into the page cache.
+    /// </summary>
+    /// <param name="offset">Offset of the range.</param>
+    /// <param name="length">Length of the range.</param>
+    void will_need(uint64_t offset, uint64_t length) const;
+
+    /// <summary>
+    /// Drop already consumed pages from the process. The data stays
+    /// in the page cache and can be shared with other readers.
+    /// </summary>
+    /// <param name="offset">Offset of the range.</param>
+    /// <param name="length">Length of the range.</param>
+    void dont_need(uint64_t offset, uint64_t length) const;
+  };
+}
@@ -0,0 +1,215 @@
+#include "hash_algorithm.hpp"
+#include "blake3.hpp"
+#include <openssl/sha.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+#include "common.hpp"
+
+namespace launcher
+{
+  namespace
+  {
+    class sha512_hasher final : public base_hasher
+    {
+    private:
+      SHA512_CTX sha512;
+
+    public:
+      sha512_hasher()
+      {
+        SHA512_Init(&sha512);
+      }
+
+      void update(const char* data, uint64_t size) override
+      {
+        SHA512_Update(&sha512, data, size);
+      }
+
+      std::string finalize() override
+      {
+        std::string hash;
+        hash.resize(SHA512_DIGEST_LENGTH);
+        SHA512_Final(reinterpret_cast<uint8_t*>(hash.data()), &sha512);
+
+        return hash;
+      }
+    };
+
+    class blake3_hasher_adapter final : public base_hasher
+    {
+    private:
+      blake3_hasher hasher;
+      bool subtree;
+
+    public:
+      blake3_hasher_adapter(uint64_t offset, bool subtree_) : hasher{ offset }, subtree{ subtree_ }
+      {}
+
+      void update(const char* data, uint64_t size) override
+      {
+        hasher.update(data, size);
+      }
+
+      std::string finalize() override
+      {
+        if (!subtree)
+        {
+          return hasher.finalize();
+        }
+
+        return finalize_segment();
+      }
+
+      std::string finalize_segment() override
+      {
+        auto cv = hasher.finalize_subtree();
+        return std::string{ reinterpret_cast<const char*>(cv.data()), sizeof(cv) };
+      }
+    };
+  }
+
+  hash_algorithms sha512_algorithm::get_id() const
+  {
+    return hash_algorithms::sha512;
+  }
+
+  std::string sha512_algorithm::get_name() const
+  {
+    return "sha512";
+  }
+
+  std::unique_ptr<base_hasher> sha512_algorithm::make_hasher() const
+  {
+    return std::make_unique<sha512_hasher>();
+  }
+
+  std::unique_ptr<base_hasher> sha512_algorithm::make_segment_hasher(uint64_t /* offset */) const
+  {
+    return std::make_unique<sha512_hasher>();
+  }
+
+  std::string sha512_algorithm::combine_segments(const std::vector<std::string>& segments) const
+  {
+    sha512_hasher hasher;
+
+    for (auto&& segment : segments)
+    {
+      hasher.update(segment.data(), segment.size());
+    }
+
+    return hasher.finalize();
+  }
+
+  hash_algorithms blake3_algorithm::get_id() const
+  {
+    return hash_algorithms::blake3;
+  }
+
+  std::string blake3_algorithm::get_name() const
+  {
+    return "blake3";
+  }
+
+  std::unique_ptr<base_hasher> blake3_algorithm::make_hasher() const
+  {
+    return std::make_unique<blake3_hasher_adapter>(0, false);
+  }
+
+  std::unique_ptr<base_hasher> blake3_algorithm::make_segment_hasher(uint64_t offset) const
+  {
+    return std::make_unique<blake3_hasher_adapter>(offset, true);
+  }
+
+  std::string blake3_algorithm::combine_segments(const std::vector<std::string>& segments) const
+  {
+    std::vector<blake3_hasher::chaining_value> subtrees(segments.size());
+
+    for (size_t j = 0; j < segments.size(); j++)
+    {
+      if (segments[j].size() != sizeof(blake3_hasher::chaining_value))
+      {
+        throw std::runtime_error{ "invalid blake3 segment" };
+      }
+
+      memcpy(subtrees[j].data(), segments[j].data(), segments[j].size());
+    }
+
+    return blake3_hasher::combine_subtrees(subtrees);
+  }
+
+  file_hasher::file_hasher(const hash_algorithm& algorithm_) : algorithm{ algorithm_ }, current{ algorithm.make_hasher() }
+  {}
+
+  void file_hasher::update(const char* data, uint64_t size)
+  {
+    while (size)
+    {
+      uint64_t segment_end = (segments.size() + 1) * common::consts::hash_segment_size;
+
+      // Segment is closed only when data follows it, a file of exactly one segment is hashed as a whole.
+      if (position == segment_end)
+      {
+        segments.push_back(segments.empty() ? current->finalize_segment() : current->finalize());
+        current = algorithm.make_segment_hasher(position);
+        segment_end += common::consts::hash_segment_size;
+      }
+
+      uint64_t step = std::min(size, segment_end - position);
+      current->update(data, step);
+
+      data += step;
+      size -= step;
+      position += step;
+    }
+  }
+
+  std::string file_hasher::finalize()
+  {
+    if (segments.empty())
+    {
+      return current->finalize();
+    }
+
+    segments.push_back(current->finalize());
+    return algorithm.combine_segments(segments);
+  }
+
+  const hash_algorithm& get_hash_algorithm(hash_algorithms id)
+  {
+    static const sha512_algorithm sha512;
+    static const blake3_algorithm blake3;
+
+    switch (id)
+    {
+      case hash_algorithms::sha512:
+      {
+        return sha512;
+      }
+      case hash_algorithms::blake3:
+      {
+        return blake3;
+      }
+    }
+
+    throw std::runtime_error{ "unknown hash algorithm" };
+  }
+
+  const hash_algorithm* find_hash_algorithm(const std::string& name)
+  {
+    for (auto id : { hash_algorithms::blake3, hash_algorithms::sha512 })
+    {
+      if (get_hash_algorithm(id).get_name() == name)
+      {
+        return &get_hash_algorithm(id);
+      }
+    }
+
+    return nullptr;
+  }
+
+  std::vector<std::string> get_supported_hash_algorithms()
+  {
+    return { get_hash_algorithm(hash_algorithms::blake3).get_name(), get_hash_algorithm(hash_algorithms::sha512).get_name() };
+  }
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace launcher
+{
+  enum class hash_algorithms : uint8_t
+  {
+    sha512,
+    blake3,
+  };
+
+  /*
+  * Incremental hash function. Hashers of file segments return an
+  * intermediate value that is only meaningful for combine_segments().
+  */
+  class base_hasher
+  {
+  public:
+    virtual void update(const char* data, uint64_t size) = 0;
+    virtual std::string finalize() = 0;
+
+    /// <summary>
+    /// Finish the hasher made by make_hasher() as the first segment of a bigger file.
+    /// </summary>
+    /// <returns>Intermediate value for combine_segments().</returns>
+    virtual std::string finalize_segment()
+    {
+      return finalize();
+    }
+
+    virtual ~base_hasher() = default;
+  };
+
+  /*
+  * Hash algorithm used for files. Client and server agree on one of them
+  * during the ping request, manifests record the algorithm they were built with.
+  * You can inherit this abstract class and register another algorithm in
+  * get_hash_algorithm() if you want.
+  */
+  class base_hash_algorithm
+  {
+  public:
+    virtual hash_algorithms get_id() const = 0;
+    virtual std::string get_name() const = 0;
+    virtual std::unique_ptr<base_hasher> make_hasher() const = 0;
+    // Segments start at multiples of common::consts::hash_segment_size and are hashed independently.
+    virtual std::unique_ptr<base_hasher> make_segment_hasher(uint64_t offset) const = 0;
+    virtual std::string combine_segments(const std::vector<std::string>& segments) const = 0;
+    virtual ~base_hash_algorithm() = default;
+  };
+
+  using hash_algorithm = base_hash_algorithm;
+
+  class sha512_algorithm final : public hash_algorithm
+  {
+  public:
+    hash_algorithms get_id() const override;
+    std::string get_name() const override;
+    std::unique_ptr<base_hasher> make_hasher() const override;
+
+    /// <summary>
+    /// Segments are plain sha512 hashes of their data.
+    /// </summary>
+    std::unique_ptr<base_hasher> make_segment_hasher(uint64_t offset) const override;
+
+    /// <summary>
+    /// Hash of a segmented file is sha512 over the concatenated raw hashes of its segments.
+    /// </summary>
+    std::string combine_segments(const std::vector<std::string>& segments) const override;
+  };
+
+  class blake3_algorithm final : public hash_algorithm
+  {
+  public:
+    hash_algorithms get_id() const override;
+    std::string get_name() const override;
+    std::unique_ptr<base_hasher> make_hasher() const override;
+
+    /// <summary>
+    /// Segments are complete subtrees of the blake3 tree, the hasher returns their chaining values.
+    /// </summary>
+    std::unique_ptr<base_hasher> make_segment_hasher(uint64_t offset) const override;
+
+    /// <summary>
+    /// Merge chaining values of the segments, the result is the regular blake3 hash of the file.
+    /// </summary>
+    std::string combine_segments(const std::vector<std::string>& segments) const override;
+  };
+
+  /*
+  * Hasher of a file that is read or written sequentially when its size
+  * isn't known in advance, e.g. of a file being downloaded. Data is split
+  * into segments the same way as by the hashing engine, so the result
+  * matches the hash of the complete file.
+  */
+  class file_hasher final : public base_hasher
+  {
+  private:
+    const hash_algorithm& algorithm;
+    std::unique_ptr<base_hasher> current; // hasher of the last segment
+    std::vector<std::string> segments; // finished segments
+    uint64_t position = 0;
+
+  public:
+    /// <summary>
+    /// Create file hasher.
+    /// </summary>
+    /// <param name="algorithm_">Hash algorithm of the file.</param>
+    file_hasher(const hash_algorithm& algorithm_);
+
+    void update(const char* data, uint64_t size) override;
+    std::string finalize() override;
+  };
+
+  /// <summary>
+  /// Get algorithm object by id.
+  /// </summary>
+  /// <param name="id">Algorithm id.</param>
+  /// <returns>Reference to the algorithm.</returns>
+  const hash_algorithm& get_hash_algorithm(hash_algorithms id);
+
+  /// <summary>
+  /// Find algorithm by its name from the ping request.
+  /// </summary>
+  /// <param name="name">Algorithm name.</param>
+  /// <returns>Pointer to the algorithm or nullptr if it's not supported.</returns>
+  const hash_algorithm* find_hash_algorithm(const std::string& name);
+
+  /// <summary>
+  /// Get names of all supported algorithms, the preferred one is first.
+  /// </summary>
+  /// <returns>Vector with names.</returns>
+  std::vector<std::string> get_supported_hash_algorithms();
+}
@@ -0,0 +1,143 @@
+#include "hashing_engine.hpp"
+#include "file_view.hpp"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <algorithm>
+
+namespace launcher
+{
+  hashing_engine::hashing_engine(uint32_t number_of_workers_) :
+    number_of_workers{ number_of_workers_ ? number_of_workers_ : std::max(1u, std::thread::hardware_concurrency()) }
+  {}
+
+  std::string hashing_engine::hash_segment(const std::string& path, uint64_t offset, uint64_t length, base_hasher& hasher)
+  {
+    file_view view{ path };
+
+    if (offset + length > view.size())
+    {
+      throw std::runtime_error{ ("file was truncated while hashing: " + std::filesystem::path{ path }.filename().string()).c_str() };
+    }
+
+    uint64_t end = offset + length;
+
+    // Hash straight from the mapping. Readahead one window ahead and drop
+    // pages behind us, so hashing of huge files doesn't bloat the process.
+    view.will_need(offset, common::consts::readahead_size);
+
+    while (offset < end)
+    {
+      uint64_t step = std::min<uint64_t>(end - offset, common::consts::readahead_size);
+
+      view.will_need(offset + step, common::consts::readahead_size);
+      view.check_range(offset, step);
+      hasher.update(view.data() + offset, step);
+      view.dont_need(offset, step);
+
+      offset += step;
+    }
+
+    return hasher.finalize();
+  }
+
+  std::vector<hashing_engine::file_hash> hashing_engine::hash_files(const std::vector<std::filesystem::path>& files, const hash_algorithm& algorithm)
+  {
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::vector<file_hash> result(files.size());
+    std::vector<std::vector<std::string>> segment_hashes(files.size());
+    std::vector<job> jobs;
+    uint64_t total_size = 0;
+
+    for (uint32_t j = 0; j < files.size(); j++)
+    {
+      auto& file = result[j];
+      file.absolute_path = std::filesystem::absolute(files[j]).string();
+      file.name = files[j].filename().string();
+      file.size = std::filesystem::file_size(files[j]);
+      total_size += file.size;
+
+      // Empty file is still a single segment.
+      uint64_t segments_num = std::max<uint64_t>(1, (file.size + common::consts::hash_segment_size - 1) / common::consts::hash_segment_size);
+      segment_hashes[j].resize(segments_num);
+
+      for (uint64_t k = 0; k < segments_num; k++)
+      {
+        uint64_t offset = k * common::consts::hash_segment_size;
+        jobs.push_back({ j, static_cast<uint32_t>(k), offset, std::min<uint64_t>(file.size - offset, common::consts::hash_segment_size) });
+      }
+    }
+
+    // Biggest jobs first, so the pool doesn't end up waiting for one late big segment.
+    std::ranges::stable_sort(jobs, std::ranges::greater{}, &job::length);
+
+    std::atomic<uint64_t> next_job = 0;
+    std::exception_ptr worker_exception;
+    std::mutex exception_mutex;
+
+    auto worker = [&]()
+    {
+      try
+      {
+        for (uint64_t j = next_job++; j < jobs.size(); j = next_job++)
+        {
+          auto& current = jobs[j];
+          auto& segments = segment_hashes[current.file_index];
+
+          // Single segment is the whole file.
+          auto hasher = segments.size() == 1 ? algorithm.make_hasher() : algorithm.make_segment_hasher(current.offset);
+          segments[current.segment_index] = hash_segment(result[current.file_index].absolute_path, current.offset, current.length, *hasher);
+        }
+      }
+      catch (...)
+      {
+        // Stop other workers and report the first failure to the caller.
+        next_job = jobs.size();
+
+        std::lock_guard lock{ exception_mutex };
+        if (!worker_exception)
+        {
+          worker_exception = std::current_exception();
+        }
+      }
+    };
+
+    std::vector<std::thread> workers;
+    uint32_t threads_num = std::max<uint64_t>(1, std::min<uint64_t>(number_of_workers, jobs.size()));
+
+    for (uint32_t j = 1; j < threads_num; j++)
+    {
+      workers.emplace_back(worker);
+    }
+
+    // Current thread is a worker too.
+    worker();
+
+    for (auto&& thread : workers)
+    {
+      thread.join();
+    }
+
+    if (worker_exception)
+    {
+      std::rethrow_exception(worker_exception);
+    }
+
+    for (uint32_t j = 0; j < files.size(); j++)
+    {
+      auto hash = segment_hashes[j].size() == 1 ? std::move(segment_hashes[j][0]) : algorithm.combine_segments(segment_hashes[j]);
+      result[j].hash_base64 = common::get_base64(hash);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    double megabytes = static_cast<double>(total_size) / 1'000'000;
+
+    std::cout << "Hashed " << files.size() << " files (" << megabytes << " MB) with " << algorithm.get_name() << " in " << seconds << " s on "
+      << threads_num << " threads: " << (seconds > 0 ? megabytes / seconds : 0) << " MB/s\n";
+
+    return result;
+  }
+}
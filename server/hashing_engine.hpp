@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <filesystem>
+#include "common.hpp"
+#include "hash_algorithm.hpp"
+
+namespace launcher
+{
+  /*
+  * Files are hashed on a pool of worker threads. Small files are
+  * a single job each, big files are split into segments of
+  * common::consts::hash_segment_size bytes, so one huge file doesn't
+  * keep a single core busy while the rest of the pool is idle.
+  * The algorithm combines hashes of the segments into the hash of
+  * the file, so the result is the same regardless of the number
+  * of workers.
+  */
+  class hashing_engine
+  {
+  public:
+    struct file_hash
+    {
+      std::string name;
+      std::string absolute_path;
+      std::string hash_base64;
+      uint64_t size;
+    };
+
+  private:
+    struct job
+    {
+      uint32_t file_index;
+      uint32_t segment_index;
+      uint64_t offset;
+      uint64_t length;
+    };
+
+    const uint32_t number_of_workers;
+
+  private:
+    /// <summary>
+    /// Hash a part of the file.
+    /// </summary>
+    /// <param name="path">Absolute path to the file.</param>
+    /// <param name="offset">Offset of the segment in bytes.</param>
+    /// <param name="length">Length of the segment in bytes.</param>
+    /// <param name="hasher">Hasher of the whole file or of the segment.</param>
+    /// <returns>Result of the hasher.</returns>
+    static std::string hash_segment(const std::string& path, uint64_t offset, uint64_t length, base_hasher& hasher);
+
+  public:
+    /// <summary>
+    /// Create hashing engine.
+    /// </summary>
+    /// <param name="number_of_workers_">Number of hashing threads. Zero means hardware concurrency.</param>
+    hashing_engine(uint32_t number_of_workers_ = 0);
+
+    /// <summary>
+    /// Hash given files in parallel and print the throughput.
+    /// </summary>
+    /// <param name="files">Paths of regular files.</param>
+    /// <param name="algorithm">Hash algorithm.</param>
+    /// <returns>Hashes in the same order as input files.</returns>
+    std::vector<file_hash> hash_files(const std::vector<std::filesystem::path>& files, const hash_algorithm& algorithm);
+  };
+}
@@ -0,0 +1,261 @@
+#include "kernel_tls.hpp"
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/crypto.h>
+#include <memory>
+#include <charconv>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
+namespace launcher
+{
+	namespace
+	{
+		const std::string secret_label = "SERVER_TRAFFIC_SECRET_0";
+
+		struct pkey_context_deleter
+		{
+			void operator()(EVP_PKEY_CTX* context) const
+			{
+				EVP_PKEY_CTX_free(context);
+			}
+		};
+
+		/// <summary>
+		/// HKDF-Expand-Label from RFC 8446 with empty context.
+		/// </summary>
+		/// <param name="md">Hash function of the cipher suite.</param>
+		/// <param name="secret">Traffic secret.</param>
+		/// <param name="label">Label without the 'tls13 ' prefix.</param>
+		/// <param name="length">Length of the output.</param>
+		/// <returns>Derived key material or empty string on failure.</returns>
+		std::string expand_label(const EVP_MD* md, const std::string& secret, const std::string& label, size_t length)
+		{
+			std::string full_label = "tls13 " + label;
+			std::string info;
+
+			info.push_back(static_cast<char>(length >> 8));
+			info.push_back(static_cast<char>(length));
+			info.push_back(static_cast<char>(full_label.size()));
+			info += full_label;
+			info.push_back(0);
+
+			std::unique_ptr<EVP_PKEY_CTX, pkey_context_deleter> context{ EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr) };
+			std::string output(length, '\0');
+
+			if (context == nullptr
+				|| EVP_PKEY_derive_init(context.get()) <= 0
+				|| EVP_PKEY_CTX_hkdf_mode(context.get(), EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) <= 0
+				|| EVP_PKEY_CTX_set_hkdf_md(context.get(), md) <= 0
+				|| EVP_PKEY_CTX_set1_hkdf_key(context.get(), reinterpret_cast<const uint8_t*>(secret.data()), static_cast<int>(secret.size())) <= 0
+				|| EVP_PKEY_CTX_add1_hkdf_info(context.get(), reinterpret_cast<const uint8_t*>(info.data()), static_cast<int>(info.size())) <= 0
+				|| EVP_PKEY_derive(context.get(), reinterpret_cast<uint8_t*>(output.data()), &length) <= 0)
+			{
+				return {};
+			}
+
+			return output;
+		}
+
+		/// <summary>
+		/// Decode hex string without exceptions, it's called from OpenSSL callbacks.
+		/// </summary>
+		/// <param name="hex">Hex encoded value.</param>
+		/// <param name="output">Decoded bytes.</param>
+		/// <returns>False if the string isn't valid hex.</returns>
+		bool decode_hex(std::string_view hex, std::string& output)
+		{
+			if (hex.empty() || hex.size() % 2)
+			{
+				return false;
+			}
+
+			output.resize(hex.size() / 2);
+
+			for (size_t j = 0; j < output.size(); j++)
+			{
+				uint8_t value;
+				auto [end, error] = std::from_chars(hex.data() + j * 2, hex.data() + j * 2 + 2, value, 16);
+
+				if (error != std::errc{} || end != hex.data() + j * 2 + 2)
+				{
+					return false;
+				}
+
+				output[j] = static_cast<char>(value);
+			}
+
+			return true;
+		}
+
+		/// <summary>
+		/// Install crypto info into the socket, TLS ULP must be enabled already.
+		/// </summary>
+		/// <typeparam name="T">Crypto info struct of the cipher.</typeparam>
+		/// <param name="socket_fd">Native socket.</param>
+		/// <param name="info">Crypto info, it's cleared after the call.</param>
+		/// <returns>True on success.</returns>
+		template<typename T>
+		bool set_crypto_info(int socket_fd, T& info)
+		{
+#ifdef __linux__
+			bool result = setsockopt(socket_fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+			OPENSSL_cleanse(&info, sizeof(info));
+
+			return result;
+#else
+			return false;
+#endif
+		}
+	}
+
+	int kernel_tls::get_secret_index()
+	{
+		static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+			[](void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+			{
+				if (auto secret = static_cast<std::string*>(ptr))
+				{
+					OPENSSL_cleanse(secret->data(), secret->size());
+					delete secret;
+				}
+			});
+
+		return index;
+	}
+
+	void kernel_tls::keylog_callback(const SSL* ssl, const char* line)
+	{
+		// Format is '<label> <client random> <secret>' with hex encoded values.
+		std::string_view entry{ line };
+
+		if (!entry.starts_with(secret_label + ' '))
+		{
+			return;
+		}
+
+		auto hex = entry.substr(entry.rfind(' ') + 1);
+		auto secret = std::make_unique<std::string>();
+
+		// Malformed line leaves no secret, the session falls back to userspace TLS.
+		if (!decode_hex(hex, *secret))
+		{
+			OPENSSL_cleanse(secret->data(), secret->size());
+			secret.reset();
+		}
+
+		auto old_secret = static_cast<std::string*>(SSL_get_ex_data(ssl, get_secret_index()));
+		delete old_secret;
+
+		SSL_set_ex_data(const_cast<SSL*>(ssl), get_secret_index(), secret.release());
+	}
+
+	void kernel_tls::prepare_context(asio::ssl::context& ssl_context)
+	{
+		get_secret_index();
+
+		SSL_CTX_set_keylog_callback(ssl_context.native_handle(), &kernel_tls::keylog_callback);
+		SSL_CTX_set_num_tickets(ssl_context.native_handle(), 0);
+	}
+
+	bool kernel_tls::enable_transmit(SSL* ssl, int socket_fd)
+	{
+#ifdef __linux__
+		auto secret = static_cast<std::string*>(SSL_get_ex_data(ssl, get_secret_index()));
+		auto cipher = SSL_get_current_cipher(ssl);
+
+		if (secret == nullptr || cipher == nullptr || SSL_version(ssl) != TLS1_3_VERSION)
+		{
+			return false;
+		}
+
+		// Cipher suites of TLS 1.3.
+		constexpr uint16_t aes_128_gcm = 0x1301;
+		constexpr uint16_t aes_256_gcm = 0x1302;
+		constexpr uint16_t chacha20_poly1305 = 0x1303;
+
+		auto suite = SSL_CIPHER_get_protocol_id(cipher);
+		auto md = suite == aes_256_gcm ? EVP_sha384() : EVP_sha256();
+		size_t key_size = suite == aes_128_gcm ? 16 : 32;
+
+		if (suite != aes_128_gcm && suite != aes_256_gcm && suite != chacha20_poly1305)
+		{
+			return false;
+		}
+
+		auto key = expand_label(md, *secret, "key", key_size);
+		auto iv = expand_label(md, *secret, "iv", 12);
+
+		// Secret isn't needed anymore.
+		OPENSSL_cleanse(secret->data(), secret->size());
+		secret->clear();
+
+		if (key.empty() || iv.empty())
+		{
+			return false;
+		}
+
+		if (setsockopt(socket_fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+		{
+			return false;
+		}
+
+		// Session tickets are disabled, so the first application record has sequence number 0.
+		bool result = false;
+
+		if (suite == chacha20_poly1305)
+		{
+			tls12_crypto_info_chacha20_poly1305 info{};
+			info.info.version = TLS_1_3_VERSION;
+			info.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+			memcpy(info.key, key.data(), sizeof(info.key));
+			memcpy(info.iv, iv.data(), sizeof(info.iv));
+
+			result = set_crypto_info(socket_fd, info);
+		}
+		else if (suite == aes_256_gcm)
+		{
+			tls12_crypto_info_aes_gcm_256 info{};
+			info.info.version = TLS_1_3_VERSION;
+			info.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+			memcpy(info.key, key.data(), sizeof(info.key));
+			memcpy(info.salt, iv.data(), sizeof(info.salt));
+			memcpy(info.iv, iv.data() + sizeof(info.salt), sizeof(info.iv));
+
+			result = set_crypto_info(socket_fd, info);
+		}
+		else
+		{
+			tls12_crypto_info_aes_gcm_128 info{};
+			info.info.version = TLS_1_3_VERSION;
+			info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+			memcpy(info.key, key.data(), sizeof(info.key));
+			memcpy(info.salt, iv.data(), sizeof(info.salt));
+			memcpy(info.iv, iv.data() + sizeof(info.salt), sizeof(info.iv));
+
+			result = set_crypto_info(socket_fd, info);
+		}
+
+		OPENSSL_cleanse(key.data(), key.size());
+		OPENSSL_cleanse(iv.data(), iv.size());
+
+		return result;
+#else
+		return false;
+#endif
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <boost/asio/ssl.hpp>
+#include <string>
+
+namespace asio = boost::asio;
+
+namespace launcher
+{
+	/*
+	* Kernel TLS for the server's side of the connection. OpenSSL performs
+	* the handshake, then the write keys of the session are installed in
+	* the socket and the kernel encrypts everything the server sends, so
+	* files can be sent with sendfile and still be encrypted. Only TLS 1.3
+	* with AES-GCM or ChaCha20-Poly1305 on Linux is supported, in other
+	* cases the session keeps encrypting with OpenSSL.
+	*/
+	class kernel_tls
+	{
+	private:
+		/// <summary>
+		/// OpenSSL keylog callback. Keeps the server's application traffic secret in the SSL object.
+		/// </summary>
+		/// <param name="ssl">Connection.</param>
+		/// <param name="line">Line in the NSS key log format.</param>
+		static void keylog_callback(const SSL* ssl, const char* line);
+
+		/// <summary>
+		/// Get index of the SSL ex data with the traffic secret.
+		/// </summary>
+		/// <returns>Ex data index.</returns>
+		static int get_secret_index();
+
+	public:
+		/// <summary>
+		/// Prepare ssl context of the acceptor. Session tickets are disabled,
+		/// so no application records are sent by OpenSSL after the handshake.
+		/// </summary>
+		/// <param name="ssl_context">Server's ssl context.</param>
+		static void prepare_context(asio::ssl::context& ssl_context);
+
+		/// <summary>
+		/// Install the server's write keys of the established connection into the socket.
+		/// After success all data of the connection must be written to the socket directly.
+		/// </summary>
+		/// <param name="ssl">Connection after the handshake.</param>
+		/// <param name="socket_fd">Native socket of the connection.</param>
+		/// <returns>False if kernel TLS isn't available, the session must keep using OpenSSL.</returns>
+		static bool enable_transmit(SSL* ssl, int socket_fd);
+	};
+}
@@ -7,7 +7,10 @@ int main()
 	try
 	{
 		uint32_t number_of_threads = 2;
-		launcher::server server_obj{ number_of_threads };
+		bool encrypted_stream = true; // false sends files unencrypted, it's faster where kernel tls isn't available
+		uint64_t total_rate = 0; // bytes per second of all update streams, 0 is unlimited
+		uint64_t session_rate = 0; // bytes per second of a single client, 0 is unlimited
+		launcher::server server_obj{ number_of_threads, encrypted_stream, total_rate, session_rate };
 
 		server_obj.run(3333);
 	}
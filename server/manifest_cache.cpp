@@ -0,0 +1,195 @@
+#include "manifest_cache.hpp"
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace launcher
+{
+  namespace
+  {
+    constexpr uint32_t manifest_magic = 0x4e414d4c; // "LMAN"
+    constexpr uint32_t manifest_version = 2;
+
+    void write_value(std::ostream& os, auto value)
+    {
+      os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void write_string(std::ostream& os, const std::string& str)
+    {
+      write_value(os, static_cast<uint32_t>(str.size()));
+      os.write(str.data(), str.size());
+    }
+
+    template<typename T>
+    T read_value(std::istream& is)
+    {
+      T value;
+
+      if (!is.read(reinterpret_cast<char*>(&value), sizeof(value)))
+      {
+        throw std::runtime_error{ "unexpected end of manifest" };
+      }
+
+      return value;
+    }
+
+    std::string read_string(std::istream& is)
+    {
+      uint32_t size = read_value<uint32_t>(is);
+
+      // Names, paths and hashes are short. Anything bigger is a damaged file.
+      if (size > 0x10000)
+      {
+        throw std::runtime_error{ "damaged manifest" };
+      }
+
+      std::string str;
+      str.resize(size);
+
+      if (!is.read(str.data(), size))
+      {
+        throw std::runtime_error{ "unexpected end of manifest" };
+      }
+
+      return str;
+    }
+  }
+
+  manifest_cache::manifest_cache(std::string cache_path_) : cache_path{ std::move(cache_path_) }
+  {
+    std::ifstream input{ cache_path, std::ios::binary };
+    if (!input)
+    {
+      return;
+    }
+
+    try
+    {
+      if (read_value<uint32_t>(input) != manifest_magic || read_value<uint32_t>(input) != manifest_version)
+      {
+        throw std::runtime_error{ "unknown manifest format" };
+      }
+
+      algorithm = static_cast<hash_algorithms>(read_value<uint8_t>(input));
+      get_hash_algorithm(algorithm); // throws on unknown algorithm
+
+      general_hash_base64 = read_string(input);
+      uint32_t entries_num = read_value<uint32_t>(input);
+
+      for (uint32_t j = 0; j < entries_num; j++)
+      {
+        std::string name = read_string(input);
+
+        entry& current = entries[std::move(name)];
+        current.absolute_path = read_string(input);
+        current.hash_base64 = read_string(input);
+        current.stat.size = read_value<uint64_t>(input);
+        current.stat.mtime = read_value<int64_t>(input);
+        current.stat.inode = read_value<uint64_t>(input);
+      }
+    }
+    catch (std::exception& e)
+    {
+      std::cout << "Ignoring manifest " << cache_path << ": " << e.what() << '\n';
+      entries.clear();
+      general_hash_base64.clear();
+    }
+  }
+
+  manifest_cache::file_stat manifest_cache::get_file_stat(const std::filesystem::path& path)
+  {
+    file_stat result;
+
+#ifndef _WIN32
+    struct stat info;
+    if (::stat(path.c_str(), &info))
+    {
+      throw std::runtime_error{ ("failed to stat file: " + path.filename().string()).c_str() };
+    }
+
+    result.size = info.st_size;
+    result.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1'000'000'000 + info.st_mtim.tv_nsec;
+    result.inode = info.st_ino;
+#else
+    result.size = std::filesystem::file_size(path);
+    result.mtime = std::filesystem::last_write_time(path).time_since_epoch().count();
+#endif
+
+    return result;
+  }
+
+  const std::string* manifest_cache::find(const std::string& name, const std::string& absolute_path, const file_stat& stat, hash_algorithms algorithm_) const
+  {
+    auto it = entries.find(name);
+
+    // Hashes made with another algorithm are useless.
+    if (algorithm != algorithm_ || it == entries.end() || it->second.absolute_path != absolute_path || it->second.stat != stat)
+    {
+      return nullptr;
+    }
+
+    return &it->second.hash_base64;
+  }
+
+  void manifest_cache::store(std::map<std::string, entry> entries_, std::string general_hash_base64_, hash_algorithms algorithm_)
+  {
+    entries = std::move(entries_);
+    general_hash_base64 = std::move(general_hash_base64_);
+    algorithm = algorithm_;
+
+    // Write into temporary file first, so a crash never leaves a half-written manifest.
+    std::string temp_path = cache_path + ".tmp";
+
+    {
+      std::ofstream output{ temp_path, std::ios::binary | std::ios::trunc };
+      if (!output)
+      {
+        std::cout << "Failed to write manifest: " << temp_path << '\n';
+        return;
+      }
+
+      write_value(output, manifest_magic);
+      write_value(output, manifest_version);
+      write_value(output, static_cast<uint8_t>(algorithm));
+      write_string(output, general_hash_base64);
+      write_value(output, static_cast<uint32_t>(entries.size()));
+
+      for (auto&& [name, current] : entries)
+      {
+        write_string(output, name);
+        write_string(output, current.absolute_path);
+        write_string(output, current.hash_base64);
+        write_value(output, current.stat.size);
+        write_value(output, current.stat.mtime);
+        write_value(output, current.stat.inode);
+      }
+    }
+
+    std::error_code e;
+    std::filesystem::rename(temp_path, cache_path, e);
+
+    if (e)
+    {
+      std::cout << "Failed to write manifest: " << e.message() << '\n';
+    }
+  }
+
+  const std::map<std::string, manifest_cache::entry>& manifest_cache::get_entries() const
+  {
+    return entries;
+  }
+
+  const std::string& manifest_cache::get_general_hash()
+  {
+    return general_hash_base64;
+  }
+
+  hash_algorithms manifest_cache::get_algorithm() const
+  {
+    return algorithm;
+  }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <map>
+#include <string>
+#include <filesystem>
+#include "common.hpp"
+#include "hash_algorithm.hpp"
+
+namespace launcher
+{
+  /*
+  * Binary manifest stored next to the working directory. It keeps the hash
+  * of every file together with the file's size, modification time and inode,
+  * so on the next start only files with changed metadata have to be rehashed.
+  * The manifest also records the hash algorithm, switching it rehashes everything.
+  */
+  class manifest_cache
+  {
+  public:
+    struct file_stat
+    {
+      uint64_t size = 0;
+      int64_t mtime = 0;
+      uint64_t inode = 0;
+
+      bool operator==(const file_stat&) const = default;
+    };
+
+    struct entry
+    {
+      std::string absolute_path;
+      std::string hash_base64;
+      file_stat stat;
+    };
+
+  private:
+    std::string cache_path;
+    std::map<std::string, entry> entries;
+    std::string general_hash_base64;
+    hash_algorithms algorithm = hash_algorithms::sha512;
+
+  public:
+    /// <summary>
+    /// Create cache object and load the manifest from disk if it exists.
+    /// Missing or damaged manifest is treated as an empty one.
+    /// </summary>
+    /// <param name="cache_path_">Path to the manifest file.</param>
+    manifest_cache(std::string cache_path_);
+
+    /// <summary>
+    /// Get size, modification time and inode of the file.
+    /// On Windows the inode is always zero.
+    /// </summary>
+    /// <param name="path">Path to the file.</param>
+    /// <returns>File metadata.</returns>
+    static file_stat get_file_stat(const std::filesystem::path& path);
+
+    /// <summary>
+    /// Find the cached hash of the file if its metadata didn't change.
+    /// </summary>
+    /// <param name="name">File name.</param>
+    /// <param name="absolute_path">Current absolute path of the file.</param>
+    /// <param name="stat">Current metadata of the file.</param>
+    /// <param name="algorithm_">Required hash algorithm.</param>
+    /// <returns>Pointer to the hash in base64 encoding or nullptr.</returns>
+    const std::string* find(const std::string& name, const std::string& absolute_path, const file_stat& stat, hash_algorithms algorithm_) const;
+
+    /// <summary>
+    /// Replace cache content and write it to disk.
+    /// </summary>
+    /// <param name="entries_">Key is file name.</param>
+    /// <param name="general_hash_base64_">Hash of all files.</param>
+    /// <param name="algorithm_">Algorithm of the hashes.</param>
+    void store(std::map<std::string, entry> entries_, std::string general_hash_base64_, hash_algorithms algorithm_);
+
+    /// <summary>
+    /// Cached entries getter.
+    /// </summary>
+    /// <returns>Key is file name.</returns>
+    const std::map<std::string, entry>& get_entries() const;
+
+    /// <summary>
+    /// General hash getter.
+    /// </summary>
+    /// <returns>General hash from the last stored manifest.</returns>
+    const std::string& get_general_hash();
+
+    /// <summary>
+    /// Algorithm getter.
+    /// </summary>
+    /// <returns>Algorithm of the cached hashes.</returns>
+    hash_algorithms get_algorithm() const;
+  };
+}
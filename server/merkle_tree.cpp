@@ -0,0 +1,195 @@
+#include "merkle_tree.hpp"
+#include <openssl/sha.h>
+#include <charconv>
+
+namespace launcher
+{
+  uint32_t merkle_tree::get_bucket(const std::string& file_name)
+  {
+    uint8_t hash[SHA512_DIGEST_LENGTH];
+    SHA512(reinterpret_cast<const uint8_t*>(file_name.data()), file_name.size(), hash);
+
+    return (static_cast<uint32_t>(hash[0]) << 8 | hash[1]) % buckets_num;
+  }
+
+  std::string merkle_tree::make_node_id(uint32_t level, uint32_t index)
+  {
+    return std::to_string(level) + '/' + std::to_string(index);
+  }
+
+  std::pair<uint32_t, uint32_t> merkle_tree::parse_node_id(std::string_view node_id)
+  {
+    uint32_t level, index;
+
+    auto separator = node_id.find('/');
+    auto end = node_id.data() + node_id.size();
+
+    if (separator == std::string_view::npos
+      || std::from_chars(node_id.data(), node_id.data() + separator, level).ptr != node_id.data() + separator
+      || std::from_chars(node_id.data() + separator + 1, end, index).ptr != end)
+    {
+      throw std::runtime_error{ "invalid merkle node id" };
+    }
+
+    uint32_t level_size = 1;
+
+    for (uint32_t j = 0; j < level && j < depth; j++)
+    {
+      level_size *= fanout;
+    }
+
+    if (level > depth || index >= level_size)
+    {
+      throw std::runtime_error{ "merkle node is out of range" };
+    }
+
+    return { level, index };
+  }
+
+  void merkle_tree::set_file(const std::string& file_name, const std::string* hash)
+  {
+    uint32_t bucket = get_bucket(file_name);
+
+    if (hash)
+    {
+      buckets[bucket][file_name] = *hash;
+    }
+    else if (auto it = buckets.find(bucket); it != buckets.end())
+    {
+      it->second.erase(file_name);
+
+      if (it->second.empty())
+      {
+        buckets.erase(it);
+      }
+    }
+
+    dirty_buckets.insert(bucket);
+  }
+
+  void merkle_tree::rehash()
+  {
+    std::set<uint32_t> dirty = std::move(dirty_buckets);
+    dirty_buckets.clear();
+
+    // Buckets hash names together with file hashes, so renames are noticed too.
+    for (uint32_t bucket : dirty)
+    {
+      auto it = buckets.find(bucket);
+
+      if (it == buckets.end())
+      {
+        levels[depth].erase(bucket);
+        continue;
+      }
+
+      SHA512_CTX sha512;
+      SHA512_Init(&sha512);
+
+      for (auto&& [name, hash] : it->second)
+      {
+        SHA512_Update(&sha512, name.c_str(), name.size() + 1);
+        SHA512_Update(&sha512, hash.c_str(), hash.size() + 1);
+      }
+
+      std::string node;
+      node.resize(SHA512_DIGEST_LENGTH);
+      SHA512_Final(reinterpret_cast<uint8_t*>(node.data()), &sha512);
+
+      levels[depth][bucket] = std::move(node);
+    }
+
+    // Walk up the tree, every level touches only parents of dirty nodes.
+    for (uint32_t level = depth; level > 0; level--)
+    {
+      std::set<uint32_t> parents;
+
+      for (uint32_t index : dirty)
+      {
+        parents.insert(index / fanout);
+      }
+
+      for (uint32_t parent : parents)
+      {
+        auto children = get_children(level - 1, parent);
+
+        if (std::ranges::all_of(children, [](auto&& child) { return child.empty(); }))
+        {
+          levels[level - 1].erase(parent);
+          continue;
+        }
+
+        const std::string empty_node(SHA512_DIGEST_LENGTH, '\0');
+
+        SHA512_CTX sha512;
+        SHA512_Init(&sha512);
+
+        for (auto&& child : children)
+        {
+          auto& data = child.empty() ? empty_node : child;
+          SHA512_Update(&sha512, data.data(), data.size());
+        }
+
+        std::string node;
+        node.resize(SHA512_DIGEST_LENGTH);
+        SHA512_Final(reinterpret_cast<uint8_t*>(node.data()), &sha512);
+
+        levels[level - 1][parent] = std::move(node);
+      }
+
+      dirty = std::move(parents);
+    }
+  }
+
+  std::string merkle_tree::get_node(uint32_t level, uint32_t index) const
+  {
+    auto it = levels[level].find(index);
+    return it == levels[level].end() ? std::string{} : it->second;
+  }
+
+  std::vector<std::string> merkle_tree::get_children(uint32_t level, uint32_t index) const
+  {
+    std::vector<std::string> children;
+    children.reserve(fanout);
+
+    for (uint32_t j = 0; j < fanout; j++)
+    {
+      children.push_back(get_node(level + 1, index * fanout + j));
+    }
+
+    return children;
+  }
+
+  const std::map<std::string, std::string>& merkle_tree::get_bucket_files(uint32_t bucket) const
+  {
+    static const std::map<std::string, std::string> empty_bucket;
+
+    auto it = buckets.find(bucket);
+    return it == buckets.end() ? empty_bucket : it->second;
+  }
+
+  std::string merkle_tree::get_digest() const
+  {
+    uint32_t level_size = 1;
+
+    for (uint32_t j = 0; j < digest_level; j++)
+    {
+      level_size *= fanout;
+    }
+
+    std::string digest(level_size * digest_prefix_size, '\0');
+
+    for (auto&& [index, hash] : levels[digest_level])
+    {
+      hash.copy(digest.data() + index * digest_prefix_size, digest_prefix_size);
+    }
+
+    return digest;
+  }
+
+  std::string merkle_tree::get_root_base64() const
+  {
+    std::string root = get_node(0, 0);
+    return root.empty() ? std::string{} : common::get_base64_from_sha512(root);
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "common.hpp"
+
+namespace launcher
+{
+  /*
+  * Hash tree over the manifest. Files are sorted into fixed leaf buckets by
+  * the hash of their name, so adding or removing a file changes only the
+  * path from its bucket to the root. Every inner node has 'fanout' children,
+  * the tree has the same shape on client and server, and the root is the
+  * general hash. To find changed files both sides compare children of
+  * differing nodes level by level and only descend where hashes differ.
+  * Empty subtrees have an empty hash and are never walked.
+  */
+  class merkle_tree
+  {
+  public:
+    static constexpr uint32_t fanout = 16;
+    static constexpr uint32_t depth = 4;
+    static constexpr uint32_t buckets_num = fanout * fanout * fanout * fanout;
+    static constexpr uint32_t digest_level = 1; // level of the nodes in the digest
+    static constexpr uint32_t digest_prefix_size = 8; // bytes of every node hash in the digest
+
+  private:
+    // Raw sha512 of non-empty nodes, levels[0] is the root, levels[depth] are buckets.
+    std::vector<std::map<uint32_t, std::string>> levels = std::vector<std::map<uint32_t, std::string>>(depth + 1);
+    // Key is bucket index, value is file name with hash in base64 encoding.
+    std::map<uint32_t, std::map<std::string, std::string>> buckets;
+    std::set<uint32_t> dirty_buckets;
+
+  public:
+    /// <summary>
+    /// Get bucket of the file.
+    /// </summary>
+    /// <param name="file_name">File name.</param>
+    /// <returns>Bucket index.</returns>
+    static uint32_t get_bucket(const std::string& file_name);
+
+    /// <summary>
+    /// Make text id of the node for the requests.
+    /// </summary>
+    /// <param name="level">Level of the node, zero is the root.</param>
+    /// <param name="index">Index of the node within the level.</param>
+    /// <returns>Node id.</returns>
+    static std::string make_node_id(uint32_t level, uint32_t index);
+
+    /// <summary>
+    /// Parse text id of the node. Throws on invalid id.
+    /// </summary>
+    /// <param name="node_id">Node id from the request.</param>
+    /// <returns>Pair where first - level, second - index.</returns>
+    static std::pair<uint32_t, uint32_t> parse_node_id(std::string_view node_id);
+
+    /// <summary>
+    /// Add, change or remove file. Hashes are recalculated by rehash().
+    /// </summary>
+    /// <param name="file_name">File name.</param>
+    /// <param name="hash">Hash in base64 encoding. Nullptr removes the file.</param>
+    void set_file(const std::string& file_name, const std::string* hash);
+
+    /// <summary>
+    /// Recalculate hashes on the paths from changed buckets to the root.
+    /// </summary>
+    void rehash();
+
+    /// <summary>
+    /// Get node hash.
+    /// </summary>
+    /// <param name="level">Level of the node.</param>
+    /// <param name="index">Index of the node within the level.</param>
+    /// <returns>Raw sha512 or empty string for empty subtree.</returns>
+    std::string get_node(uint32_t level, uint32_t index) const;
+
+    /// <summary>
+    /// Get hashes of all children of the node.
+    /// </summary>
+    /// <param name="level">Level of the node, must be less than depth.</param>
+    /// <param name="index">Index of the node within the level.</param>
+    /// <returns>Vector of 'fanout' raw hashes, empty string for empty subtree.</returns>
+    std::vector<std::string> get_children(uint32_t level, uint32_t index) const;
+
+    /// <summary>
+    /// Get files of the bucket.
+    /// </summary>
+    /// <param name="bucket">Bucket index.</param>
+    /// <returns>Map where key is file name and value is hash in base64 encoding.</returns>
+    const std::map<std::string, std::string>& get_bucket_files(uint32_t bucket) const;
+
+    /// <summary>
+    /// Get compact digest of the tree, it lets the server find differing
+    /// subtrees without walking the tree with the client.
+    /// </summary>
+    /// <returns>Prefixes of hashes of all nodes at digest_level, zeros for empty subtrees.</returns>
+    std::string get_digest() const;
+
+    /// <summary>
+    /// Root getter.
+    /// </summary>
+    /// <returns>Root hash in base64 encoding. Empty string for empty tree.</returns>
+    std::string get_root_base64() const;
+  };
+}
@@ -0,0 +1,202 @@
+#include "message_codec.hpp"
+#include <string.h>
+#include <stdexcept>
+
+namespace launcher
+{
+  void messages::message_writer::append(const void* data, size_t size)
+  {
+    auto offset = buffer.size();
+    buffer.resize(offset + size);
+
+    if (size)
+    {
+      memcpy(buffer.data() + offset, data, size);
+    }
+  }
+
+  void messages::message_writer::append_string(std::string_view str)
+  {
+    uint32_t size = static_cast<uint32_t>(str.size());
+
+    append(&size, sizeof(size));
+    append(str.data(), str.size());
+  }
+
+  void messages::message_writer::append_strings(const std::vector<std::string>& strings)
+  {
+    uint32_t count = static_cast<uint32_t>(strings.size());
+    append(&count, sizeof(count));
+
+    for (auto&& str : strings)
+    {
+      append_string(str);
+    }
+  }
+
+  void messages::message_writer::begin()
+  {
+    // Size prefix is filled in when the payload is complete.
+    buffer.resize(sizeof(uint32_t));
+    append(&wire_version, sizeof(wire_version));
+    append(&correlation_id, sizeof(correlation_id));
+  }
+
+  void messages::message_writer::end()
+  {
+    uint32_t size = static_cast<uint32_t>(buffer.size() - sizeof(size));
+
+    if (size > common::consts::max_message_size)
+    {
+      throw std::runtime_error{ "message is too big" };
+    }
+
+    memcpy(buffer.data(), &size, sizeof(size));
+  }
+
+  void messages::message_writer::set_correlation_id(uint32_t correlation_id_)
+  {
+    correlation_id = correlation_id_;
+  }
+
+  messages::message_writer& messages::message_writer::operator<<(const request& obj)
+  {
+    auto request_id = static_cast<uint8_t>(obj.request_id);
+
+    begin();
+    append(&request_id, sizeof(request_id));
+    append_strings(obj.request_content);
+    end();
+
+    return *this;
+  }
+
+  messages::message_writer& messages::message_writer::operator<<(const response& obj)
+  {
+    auto status = static_cast<uint8_t>(obj.status);
+
+    begin();
+    append(&status, sizeof(status));
+    append_string(obj.message);
+    append_strings(obj.response_content);
+    end();
+
+    return *this;
+  }
+
+  asio::const_buffer messages::message_writer::get_buffer() const
+  {
+    return asio::buffer(buffer);
+  }
+
+  size_t messages::message_writer::capacity() const
+  {
+    return buffer.capacity();
+  }
+
+  void messages::message_reader::take(void* data, size_t size)
+  {
+    if (input.size() < size)
+    {
+      throw std::runtime_error{ "truncated message" };
+    }
+
+    memcpy(data, input.data(), size);
+    input.remove_prefix(size);
+  }
+
+  std::string_view messages::message_reader::take_string()
+  {
+    uint32_t size;
+    take(&size, sizeof(size));
+
+    if (input.size() < size)
+    {
+      throw std::runtime_error{ "truncated message" };
+    }
+
+    auto str = input.substr(0, size);
+    input.remove_prefix(size);
+
+    return str;
+  }
+
+  void messages::message_reader::take_strings(std::vector<std::string_view>& strings)
+  {
+    uint32_t count;
+    take(&count, sizeof(count));
+
+    // Every string has at least its size prefix, so a bogus count can't make us allocate much.
+    if (count > input.size() / sizeof(uint32_t))
+    {
+      throw std::runtime_error{ "truncated message" };
+    }
+
+    strings.clear();
+
+    for (uint32_t j = 0; j < count; j++)
+    {
+      strings.push_back(take_string());
+    }
+  }
+
+  void messages::message_reader::begin()
+  {
+    input = std::string_view{ buffer.data(), buffer.size() };
+
+    uint8_t version;
+    take(&version, sizeof(version));
+
+    if (version != wire_version)
+    {
+      throw std::runtime_error{ "unsupported message version" };
+    }
+  }
+
+  asio::mutable_buffer messages::message_reader::prepare(uint32_t size)
+  {
+    if (size > common::consts::max_message_size)
+    {
+      throw std::runtime_error{ "message is too big" };
+    }
+
+    buffer.resize(size);
+    input = {};
+
+    return asio::buffer(buffer);
+  }
+
+  messages::message_reader& messages::message_reader::operator>>(request_view& obj)
+  {
+    uint8_t request_id;
+
+    begin();
+    take(&obj.correlation_id, sizeof(obj.correlation_id));
+    take(&request_id, sizeof(request_id));
+    take_strings(obj.request_content);
+
+    obj.request_id = static_cast<request_ids>(request_id);
+
+    return *this;
+  }
+
+  messages::message_reader& messages::message_reader::operator>>(response_view& obj)
+  {
+    uint8_t status;
+
+    begin();
+    take(&obj.correlation_id, sizeof(obj.correlation_id));
+    take(&status, sizeof(status));
+    obj.message = take_string();
+    take_strings(obj.response_content);
+
+    obj.status = static_cast<status_codes>(status);
+
+    return *this;
+  }
+
+  size_t messages::message_reader::capacity() const
+  {
+    return buffer.capacity();
+  }
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+#include <boost/asio.hpp>
+#include "common.hpp"
+
+namespace asio = boost::asio;
+
+namespace launcher
+{
+  namespace messages
+  {
+    inline constexpr uint8_t wire_version = 2; // version of the message format, the first byte of every payload
+
+    /*
+    * Flat wire format of requests and responses. Every message is prefixed by
+    * the uint32_t size of its payload, the payload is a sequence of fixed size
+    * fields and strings prefixed by their uint32_t size:
+    *   request  - version, uint32_t correlation id, uint8_t request id, uint32_t number of strings, strings
+    *   response - version, uint32_t correlation id, uint8_t status, message, uint32_t number of strings, strings
+    * The server answers with the correlation id of the request, responses to
+    * requests that are processed concurrently may come in any order.
+    * Both sides keep their buffers between messages, so once they have grown
+    * messages are encoded and decoded without allocations.
+    */
+    class message_writer
+    {
+    private:
+      std::vector<char> buffer; // size prefix followed by the payload
+      uint32_t correlation_id = 0;
+
+    private:
+      /// <summary>
+      /// Append raw bytes to the payload.
+      /// </summary>
+      /// <param name="data">Pointer to the data.</param>
+      /// <param name="size">Size of the data.</param>
+      void append(const void* data, size_t size);
+
+      /// <summary>
+      /// Append size-prefixed string to the payload.
+      /// </summary>
+      /// <param name="str">String itself.</param>
+      void append_string(std::string_view str);
+
+      /// <summary>
+      /// Append number of strings and the strings.
+      /// </summary>
+      /// <param name="strings">Strings to append.</param>
+      void append_strings(const std::vector<std::string>& strings);
+
+      /// <summary>
+      /// Start new message, the previous one is discarded.
+      /// </summary>
+      void begin();
+
+      /// <summary>
+      /// Write size of the finished payload into the prefix.
+      /// </summary>
+      void end();
+
+    public:
+      /// <summary>
+      /// Set correlation id of the messages encoded next.
+      /// </summary>
+      /// <param name="correlation_id_">Id chosen by the client for the request, the response repeats it.</param>
+      void set_correlation_id(uint32_t correlation_id_);
+
+      /// <summary>
+      /// Encode request.
+      /// </summary>
+      /// <param name="obj">Request to encode.</param>
+      /// <returns>Writer itself.</returns>
+      message_writer& operator<<(const request& obj);
+
+      /// <summary>
+      /// Encode response.
+      /// </summary>
+      /// <param name="obj">Response to encode.</param>
+      /// <returns>Writer itself.</returns>
+      message_writer& operator<<(const response& obj);
+
+      /// <summary>
+      /// Get the encoded message with its size prefix, ready to be written to the socket.
+      /// </summary>
+      /// <returns>Buffer that is valid until the next message is encoded.</returns>
+      asio::const_buffer get_buffer() const;
+
+      /// <summary>
+      /// Get memory held by the buffer, it never shrinks.
+      /// </summary>
+      /// <returns>Capacity in bytes.</returns>
+      size_t capacity() const;
+    };
+
+    class message_reader
+    {
+    private:
+      std::vector<char> buffer; // payload of the last message
+      std::string_view input; // part of the payload that isn't decoded yet
+
+    private:
+      /// <summary>
+      /// Take raw bytes from the payload. Throws if the payload is too short.
+      /// </summary>
+      /// <param name="data">Output pointer.</param>
+      /// <param name="size">Number of bytes.</param>
+      void take(void* data, size_t size);
+
+      /// <summary>
+      /// Take size-prefixed string from the payload.
+      /// </summary>
+      /// <returns>View into the buffer.</returns>
+      std::string_view take_string();
+
+      /// <summary>
+      /// Take number of strings and the strings.
+      /// </summary>
+      /// <param name="strings">Output vector, its capacity is reused.</param>
+      void take_strings(std::vector<std::string_view>& strings);
+
+      /// <summary>
+      /// Check the version of the payload.
+      /// </summary>
+      void begin();
+
+    public:
+      /// <summary>
+      /// Get buffer for the payload of the next message. Views of the
+      /// previously decoded message become invalid.
+      /// </summary>
+      /// <param name="size">Size of the payload from the prefix.</param>
+      /// <returns>Buffer to read the payload into.</returns>
+      asio::mutable_buffer prepare(uint32_t size);
+
+      /// <summary>
+      /// Decode request from the payload.
+      /// </summary>
+      /// <param name="obj">Output request, it points into the buffer of the reader.</param>
+      /// <returns>Reader itself.</returns>
+      message_reader& operator>>(request_view& obj);
+
+      /// <summary>
+      /// Decode response from the payload.
+      /// </summary>
+      /// <param name="obj">Output response, it points into the buffer of the reader.</param>
+      /// <returns>Reader itself.</returns>
+      message_reader& operator>>(response_view& obj);
+
+      /// <summary>
+      /// Get memory held by the buffer, it never shrinks.
+      /// </summary>
+      /// <returns>Capacity in bytes.</returns>
+      size_t capacity() const;
+    };
+  }
+}
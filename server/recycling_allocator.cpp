@@ -0,0 +1,81 @@
+#include "recycling_allocator.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace launcher
+{
+	namespace
+	{
+		thread_local bool pool_destroyed = false; // trivially destructible, readable after the pool is gone
+	}
+
+	recycling_pool::~recycling_pool()
+	{
+		for (size_t j = 0; j < classes_num; j++)
+		{
+			while (free_lists[j])
+			{
+				::operator delete(std::exchange(free_lists[j], free_lists[j]->next));
+			}
+		}
+
+		pool_destroyed = true;
+	}
+
+	size_t recycling_pool::get_class(size_t size)
+	{
+		size_t index = 0;
+
+		for (size_t block_size = min_block_size; block_size < size && index < classes_num; block_size <<= 1)
+		{
+			index++;
+		}
+
+		return index;
+	}
+
+	recycling_pool* recycling_pool::get()
+	{
+		// Blocks may be freed by thread_local objects destroyed after the pool.
+		if (pool_destroyed)
+		{
+			return nullptr;
+		}
+
+		thread_local recycling_pool pool;
+		return &pool;
+	}
+
+	void* recycling_pool::allocate(size_t size)
+	{
+		auto index = get_class(size);
+
+		if (index == classes_num)
+		{
+			return ::operator new(size);
+		}
+
+		if (auto pool = get(); pool && pool->free_lists[index])
+		{
+			pool->free_counts[index]--;
+			return std::exchange(pool->free_lists[index], pool->free_lists[index]->next);
+		}
+
+		return ::operator new(min_block_size << index);
+	}
+
+	void recycling_pool::deallocate(void* ptr, size_t size) noexcept
+	{
+		auto index = get_class(size);
+		auto pool = index == classes_num ? nullptr : get();
+
+		if (pool == nullptr || pool->free_counts[index] >= std::max<size_t>(4, class_capacity / (min_block_size << index)))
+		{
+			::operator delete(ptr);
+			return;
+		}
+
+		pool->free_counts[index]++;
+		pool->free_lists[index] = new (ptr) free_block{ pool->free_lists[index] };
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <stddef.h>
+#include <cstddef>
+#include <array>
+#include <new>
+
+namespace launcher
+{
+	/*
+	* Per-thread free lists of memory blocks. Sizes are rounded up to a power
+	* of two and freed blocks are kept by size class, so objects that are
+	* created and destroyed all the time, like sessions and their buffers,
+	* stop reaching the global allocator once the pool is warm. A block may be
+	* freed on any thread, it goes to the pool of that thread. Every class
+	* keeps a bounded number of blocks, large blocks aren't pooled at all.
+	*/
+	class recycling_pool
+	{
+	private:
+		static constexpr size_t min_block_size = 64;
+		static constexpr size_t classes_num = 13; // up to 256 KiB
+		static constexpr size_t class_capacity = 0x100000; // 1 MiB of free blocks per class, at least 4 blocks
+
+		struct free_block
+		{
+			free_block* next;
+		};
+
+		std::array<free_block*, classes_num> free_lists{};
+		std::array<size_t, classes_num> free_counts{};
+
+	private:
+		recycling_pool() = default;
+
+		/// <summary>
+		/// Destroy the pool of the exiting thread, later frees go to the global allocator.
+		/// </summary>
+		~recycling_pool();
+
+		/// <summary>
+		/// Get size class of the block.
+		/// </summary>
+		/// <param name="size">Requested size.</param>
+		/// <returns>Class index or classes_num if the block isn't pooled.</returns>
+		static size_t get_class(size_t size);
+
+		/// <summary>
+		/// Get pool of the current thread.
+		/// </summary>
+		/// <returns>Pool or nullptr if the thread is exiting.</returns>
+		static recycling_pool* get();
+
+	public:
+		/// <summary>
+		/// Allocate block, a free one of the same class is reused.
+		/// </summary>
+		/// <param name="size">Size in bytes.</param>
+		/// <returns>Block aligned for any fundamental type.</returns>
+		static void* allocate(size_t size);
+
+		/// <summary>
+		/// Return block to the pool of the current thread.
+		/// </summary>
+		/// <param name="ptr">Block from allocate().</param>
+		/// <param name="size">Size passed to allocate().</param>
+		static void deallocate(void* ptr, size_t size) noexcept;
+	};
+
+	/// <summary>
+	/// Standard allocator on top of the per-thread recycling pool.
+	/// Stateless, so any instance frees memory of any other.
+	/// </summary>
+	template<typename T>
+	class recycling_allocator
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "overaligned types aren't supported");
+
+	public:
+		using value_type = T;
+
+		recycling_allocator() noexcept = default;
+
+		template<typename U>
+		recycling_allocator(const recycling_allocator<U>&) noexcept
+		{}
+
+		T* allocate(size_t n)
+		{
+			return static_cast<T*>(recycling_pool::allocate(n * sizeof(T)));
+		}
+
+		void deallocate(T* ptr, size_t n) noexcept
+		{
+			recycling_pool::deallocate(ptr, n * sizeof(T));
+		}
+
+		template<typename U>
+		bool operator==(const recycling_allocator<U>&) const noexcept
+		{
+			return true;
+		}
+	};
+}
@@ -4,16 +4,25 @@
 
 namespace launcher
 {
-	server::server(uint32_t number_of_workers_) : ioc{ number_of_workers_ }, stop{ false }, number_of_workers{ number_of_workers_ }
+	server::server(uint32_t number_of_workers_, bool encrypted_stream, uint64_t total_rate, uint64_t session_rate) : ioc{ number_of_workers_ }, stop{ false }, number_of_workers{ number_of_workers_ }
 	{
 		// Prevent io_context from stopping when there are no tasks in queue.
 		work_object = std::make_unique<asio::io_context::work>(ioc);
 
 		auto [conn_str, table_name, login_column_name, password_column_name] = db::postgre_db::get_database_conn_data();
 
-		// Pair with database module and file handler.
-		database_file_handler.first = std::shared_ptr<db::database>{ new db::postgre_db{ conn_str, table_name, login_column_name, password_column_name, ioc } };
-		database_file_handler.second = std::make_shared<file_handler>("data");
+		// Database module, file handler, chunk index for the delta transfer, compressed copies of files, asynchronous file reads, shared compressed chunks and bandwidth shaping.
+		modules.database = std::shared_ptr<db::database>{ new db::postgre_db{ conn_str, table_name, login_column_name, password_column_name, ioc } };
+		modules.files = std::make_shared<file_handler>("data", hash_algorithms::blake3, common::consts::release_history);
+		modules.chunks = std::make_shared<chunk_index>();
+		modules.compressed = std::make_shared<compressed_store>(modules.files);
+		modules.reader = std::make_shared<file_reader>(ioc);
+		modules.hot_chunks = std::make_shared<chunk_cache>();
+		modules.bandwidth = std::make_shared<bandwidth_scheduler>(ioc, total_rate, session_rate);
+		modules.encrypted_stream = encrypted_stream;
+
+		// Rehash and publish changes of the data directory without restart.
+		watcher = std::make_unique<directory_watcher>(modules.files);
 
 		/*
 		* Server uses model with a single io_context object. Client handling
@@ -36,6 +45,7 @@ namespace launcher
 			acc->get_socket().cancel();
 		}
 
+		watcher.reset();
 		ioc.stop();
 	}
 
@@ -43,7 +53,7 @@ namespace launcher
 	{
 		try
 		{
-			acc = std::make_unique<acceptor>(ioc, port_num, database_file_handler);
+			acc = std::make_unique<acceptor>(ioc, port_num, modules);
 		}
 		catch (std::exception& e)
 		{
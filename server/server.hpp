@@ -7,6 +7,8 @@
 #include "database.hpp"
 #include "acceptor.hpp"
 #include "file_handler.hpp"
+#include "directory_watcher.hpp"
+#include "session_modules.hpp"
 
 namespace asio = boost::asio;
 
@@ -20,9 +22,9 @@ namespace launcher
 		std::vector<std::shared_ptr<std::thread>> threads;
 		const uint32_t number_of_workers;
 		std::unique_ptr<asio::io_context::work> work_object;
-		std::shared_ptr<db::database> database;
-		std::pair<std::shared_ptr<db::database>, std::shared_ptr<file_handler>> database_file_handler;
+		session_modules modules;
 		std::unique_ptr<acceptor> acc;
+		std::unique_ptr<directory_watcher> watcher;
 
 	public:
 		/// <summary>
@@ -30,7 +32,10 @@ namespace launcher
 		/// Default value is std::thread::hardware_concurrency.
 		/// </summary>
 		/// <param name="number_of_workers_">Number of threads for the server object.</param>
-		server(uint32_t number_of_workers_ = std::thread::hardware_concurrency());
+		/// <param name="encrypted_stream">Send files through tls, otherwise they go past the ssl layer unencrypted.</param>
+		/// <param name="total_rate">Bytes per second of all update streams, 0 is unlimited.</param>
+		/// <param name="session_rate">Bytes per second of a single update stream, 0 is unlimited.</param>
+		server(uint32_t number_of_workers_ = std::thread::hardware_concurrency(), bool encrypted_stream = true, uint64_t total_rate = 0, uint64_t session_rate = 0);
 
 		/// <summary>
 		/// Stop threads, executor and acceptor socket. You should
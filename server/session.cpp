@@ -1,14 +1,69 @@
 #include "session.hpp"
+#include "file_view.hpp"
+#include "kernel_tls.hpp"
+#include <unordered_map>
+#include <string_view>
 #include <iostream>
 #include <ranges>
+#include <iterator>
 #include <algorithm>
 #include <filesystem>
-#include <fstream>
+#include <array>
+#include <atomic>
+#include <span>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <string.h>
+#endif
 
 namespace launcher
 {
-	session::session(asio::io_context& ioc, asio::ssl::context& ssl_context, std::shared_ptr<db::database> db_ptr_, std::shared_ptr<file_handler> fh_ptr_) :
-		ssl_stream{ ioc, ssl_context }, db_ptr{ std::move(db_ptr_) }, fh_ptr{ std::move(fh_ptr_) }
+	namespace
+	{
+		constexpr size_t stream_buffer_size = 0x10000; // small frames are collected up to this size before writing
+		constexpr size_t request_pool_size = 32; // request objects kept by every thread
+		constexpr uint32_t max_requests_running = 16; // a client that doesn't read responses can't make the session hold more
+
+		/// <summary>
+		/// Compress chunk for the chunk cache. Must not be a coroutine: the context and the
+		/// output buffer are shared by sessions running on the current thread.
+		/// </summary>
+		/// <param name="data">Raw data.</param>
+		/// <param name="size">Size of the data.</param>
+		/// <returns>Chunk with a buffer of the exact size, empty if the data doesn't shrink.</returns>
+		std::shared_ptr<chunk_cache::chunk> compress_chunk(const char* data, uint32_t size)
+		{
+			thread_local compressed_store::compression_context compression_context;
+			thread_local std::vector<char> compression_buf;
+
+			if (compression_context == nullptr)
+			{
+				compression_context.reset(ZSTD_createCCtx());
+
+				if (compression_context == nullptr)
+				{
+					throw std::runtime_error{ "failed to create compression context" };
+				}
+			}
+
+			auto compressed = std::make_shared<chunk_cache::chunk>();
+			compressed->raw_size = size;
+
+			uint32_t stored_size = compressed_store::compress_block(compression_context.get(), data, size, compression_buf);
+			compressed->data.assign(compression_buf.data(), compression_buf.data() + stored_size);
+
+			return compressed;
+		}
+	}
+
+	thread_local std::vector<std::unique_ptr<session::pending_request>> session::request_pool;
+
+	session::session(asio::io_context& ioc, asio::ssl::context& ssl_context, const session_modules& modules) :
+		ssl_stream{ asio::make_strand(ioc), ssl_context }, db_ptr{ modules.database }, fh_ptr{ modules.files }, ci_ptr{ modules.chunks }, cs_ptr{ modules.compressed }, fr_ptr{ modules.reader }, cc_ptr{ modules.hot_chunks },
+		bs_ptr{ modules.bandwidth }, encrypted_stream{ modules.encrypted_stream }, writer_released{ ssl_stream.get_executor(), asio::steady_timer::time_point::max() },
+		flow{ bs_ptr->open_flow(ssl_stream.get_executor()) }, requests_finished{ ssl_stream.get_executor(), asio::steady_timer::time_point::max() }
 	{}
 
 	asio::awaitable<void> session::handle_client(std::shared_ptr<session> this_ptr)
@@ -17,88 +72,204 @@ namespace launcher
 		{
 			co_await this_ptr->ssl_stream.async_handshake(asio::ssl::stream_base::server, asio::use_awaitable);
 
-			asio::streambuf request_buf;
-			std::stringstream response_buf;
-			messages::request request;
+			if (this_ptr->encrypted_stream)
+			{
+				this_ptr->kernel_tls_enabled = kernel_tls::enable_transmit(this_ptr->ssl_stream.native_handle(), this_ptr->ssl_stream.next_layer().native_handle());
+
+				// OpenSSL has to encrypt the stream, files can't go straight to the socket.
+				this_ptr->zero_copy = this_ptr->kernel_tls_enabled;
 
-			boost::archive::binary_oarchive response_stream(response_buf, boost::archive::no_codecvt | boost::archive::no_header); // Serialized data.
-			boost::archive::binary_iarchive input_data(request_buf, boost::archive::no_codecvt | boost::archive::no_header);
+				static std::atomic<bool> fallback_reported = false;
+
+				if (!this_ptr->kernel_tls_enabled && !fallback_reported.exchange(true))
+				{
+					std::cout << "Kernel TLS isn't available, update stream is encrypted by OpenSSL\n";
+				}
+			}
 
 			uint32_t message_size;
 			auto message_size_buf = asio::buffer(&message_size, 4);
 
-			// Client processing loop.
+			// Client processing loop. Requests are read while earlier ones are still processed,
+			// responses carry correlation ids of their requests and may go out of order.
 			while (true)
 			{
 				co_await asio::async_read(this_ptr->ssl_stream, message_size_buf, asio::use_awaitable);
-				co_await asio::async_read(this_ptr->ssl_stream, request_buf.prepare(message_size), asio::use_awaitable);
 
-				request_buf.commit(message_size);
-				input_data >> request;
+				// Buffers of finished requests are reused, the request is decoded in place. Idle sessions hold none.
+				auto pending = take_request();
+				co_await asio::async_read(this_ptr->ssl_stream, pending->input.prepare(message_size), asio::use_awaitable);
+
+				pending->input >> pending->request;
 
-				switch (request.request_id)
+				// Requests that change the state of the session are processed alone. The update stream
+				// also takes the connection over and reads acknowledgements, so nothing else may be read meanwhile.
+				switch (pending->request.request_id)
 				{
 					case messages::request_ids::authorization:
-					{
-						co_await this_ptr->handle_authorization(request, response_stream);
-						break;
-					}
 					case messages::request_ids::registration:
-					{
-						co_await this_ptr->handle_registration(request, response_stream);
-						break;
-					}
 					case messages::request_ids::ping:
-					{
-						response_stream << messages::response{ messages::status_codes::success, "Server response" };
-						break;
-					}
-					case messages::request_ids::check_general_hash:
-					{
-						this_ptr->handle_general_hash_check(request, response_stream);
-						break;
-					}
 					case messages::request_ids::get_update:
 					{
-						co_await this_ptr->handle_update(request, response_stream);
+						while (this_ptr->requests_running)
+						{
+							boost::system::error_code e;
+							co_await this_ptr->requests_finished.async_wait(asio::redirect_error(asio::use_awaitable, e));
+						}
+
+						co_await this_ptr->process_request(*pending);
+						recycle_request(std::move(pending));
 						break;
 					}
 					default:
 					{
-						response_stream << messages::response{ messages::status_codes::incorrect_input, "Failed to process request: invalid meessage id" };
+						while (this_ptr->requests_running >= max_requests_running)
+						{
+							boost::system::error_code e;
+							co_await this_ptr->requests_finished.async_wait(asio::redirect_error(asio::use_awaitable, e));
+						}
+
+						auto current = pending.release();
+						this_ptr->requests_running++;
+
+						asio::co_spawn(this_ptr->ssl_stream.get_executor(), this_ptr->process_request(*current), [this_ptr, current](std::exception_ptr failure)
+							{
+								// Only a failed write gets here, the stream is broken. Closing the socket stops the read loop.
+								if (failure)
+								{
+									try
+									{
+										std::rethrow_exception(failure);
+									}
+									catch (std::exception& e)
+									{
+										std::cout << "Client communication fail: " << e.what() << '\n';
+									}
+
+									boost::system::error_code e;
+									this_ptr->ssl_stream.next_layer().close(e);
+								}
+
+								recycle_request(std::unique_ptr<pending_request>{ current });
+								this_ptr->requests_running--;
+								this_ptr->requests_finished.cancel();
+							});
 						break;
 					}
 				}
+			}
+		}
+		catch (std::exception& e)
+		{
+			std::cout << "Client communication fail: " << e.what() << '\n';
+		}
+	}
 
-				// Send response to the client.
-				message_size = common::get_stream_size(response_buf);
+	std::unique_ptr<session::pending_request> session::take_request()
+	{
+		if (request_pool.empty())
+		{
+			return std::make_unique<pending_request>();
+		}
 
-				co_await asio::async_write(this_ptr->ssl_stream, message_size_buf, asio::use_awaitable);
-				co_await asio::async_write(this_ptr->ssl_stream, asio::buffer(response_buf.str()), asio::use_awaitable);
+		auto pending = std::move(request_pool.back());
+		request_pool.pop_back();
 
-				// Get ready to process another message.
-				response_buf.clear();
-				response_buf.str({});
+		return pending;
+	}
 
-				if (request_buf.size())
+	void session::recycle_request(std::unique_ptr<pending_request> pending)
+	{
+		if (request_pool.size() < request_pool_size && pending->input.capacity() <= common::consts::MiB && pending->output.capacity() <= common::consts::MiB)
+		{
+			request_pool.push_back(std::move(pending));
+		}
+	}
+
+	asio::awaitable<void> session::process_request(pending_request& pending)
+	{
+		auto& request = pending.request;
+		auto& response_stream = pending.output;
+
+		response_stream.set_correlation_id(request.correlation_id);
+
+		try
+		{
+			switch (request.request_id)
+			{
+				case messages::request_ids::authorization:
+				{
+					co_await handle_authorization(request, response_stream);
+					break;
+				}
+				case messages::request_ids::registration:
+				{
+					co_await handle_registration(request, response_stream);
+					break;
+				}
+				case messages::request_ids::ping:
+				{
+					handle_ping(request, response_stream);
+					break;
+				}
+				case messages::request_ids::check_general_hash:
+				{
+					handle_general_hash_check(request, response_stream);
+					break;
+				}
+				case messages::request_ids::get_update:
+				{
+					co_await handle_update(request, response_stream);
+					break;
+				}
+				case messages::request_ids::get_merkle_nodes:
+				{
+					handle_merkle_nodes(request, response_stream);
+					break;
+				}
+				case messages::request_ids::get_merkle_buckets:
+				{
+					handle_merkle_buckets(request, response_stream);
+					break;
+				}
+				case messages::request_ids::sync:
+				{
+					handle_sync(request, response_stream);
+					break;
+				}
+				default:
 				{
-					request_buf.consume(request_buf.size());
+					response_stream << messages::response{ messages::status_codes::incorrect_input, "Failed to process request: invalid meessage id", {} };
+					break;
 				}
 			}
 		}
 		catch (std::exception& e)
 		{
-			std::cout << "Client communication fail: " << e.what() << '\n';
+			// The update stream is broken half way, only closing the connection helps.
+			if (request.request_id == messages::request_ids::get_update)
+			{
+				throw;
+			}
+
+			// E.g. the answer is too big. The client still waits for a response with this correlation id.
+			response_stream << messages::response{ messages::status_codes::fail, e.what(), {} };
 		}
+
+		// Send response to the client, it's prefixed by its size. Responses of concurrent requests don't interleave.
+		co_await acquire_writer();
+		writer_guard guard{ *this };
+
+		co_await write_secure(response_stream.get_buffer());
 	}
 
-	asio::awaitable<void> session::handle_authorization(messages::request& input_data, boost::archive::binary_oarchive& response_stream)
+	asio::awaitable<void> session::handle_authorization(const messages::request_view& input_data, messages::message_writer& response_stream)
 	{
 		try
 		{
 			if (sign_in_status)
 			{
-				response_stream << messages::response{ messages::status_codes::already_authorized };
+				response_stream << messages::response{ messages::status_codes::already_authorized, {}, {} };
 				co_return;
 			}
 
@@ -110,20 +281,20 @@ namespace launcher
 			if (is_correct)
 			{
 				sign_in_status = true;
-				response_stream << messages::response{ messages::status_codes::success };
+				response_stream << messages::response{ messages::status_codes::success, {}, {} };
 			}
 			else
 			{
-				response_stream << messages::response{ messages::status_codes::incorrect_input, "Wrong password or login" };
+				response_stream << messages::response{ messages::status_codes::incorrect_input, "Wrong password or login", {} };
 			}
 		}
 		catch (std::exception& e)
 		{
-			response_stream << messages::response{ messages::status_codes::fail, e.what() };
+			response_stream << messages::response{ messages::status_codes::fail, e.what(), {} };
 		}
 	}
 
-	asio::awaitable<void> session::handle_registration(messages::request& input_data, boost::archive::binary_oarchive& response_stream)
+	asio::awaitable<void> session::handle_registration(const messages::request_view& input_data, messages::message_writer& response_stream)
 	{
 		try
 		{
@@ -136,20 +307,69 @@ namespace launcher
 
 				co_await db_ptr->add_login_pass(login, password);
 
-				response_stream << messages::response{ messages::status_codes::success };
+				response_stream << messages::response{ messages::status_codes::success, {}, {} };
 			}
 			else
 			{
-				response_stream << messages::response{ messages::status_codes::incorrect_input, "Login or password was in incorrect format" };
+				response_stream << messages::response{ messages::status_codes::incorrect_input, "Login or password was in incorrect format", {} };
 			}
 		}
 		catch (std::exception& e)
 		{
-			response_stream << messages::response{ messages::status_codes::fail, e.what() };
+			response_stream << messages::response{ messages::status_codes::fail, e.what(), {} };
+		}
+	}
+
+	void session::handle_ping(const messages::request_view& input_data, messages::message_writer& response_stream)
+	{
+		auto& algorithm = get_hash_algorithm(fh_ptr->get_manifest()->algorithm);
+		auto client_algorithms = input_data.get_hash_algorithms();
+
+		// Launchers without negotiation know only sha512.
+		if (client_algorithms.empty())
+		{
+			client_algorithms.push_back(get_hash_algorithm(hash_algorithms::sha512).get_name());
+		}
+
+		if (std::ranges::find(client_algorithms, algorithm.get_name()) == client_algorithms.end())
+		{
+			response_stream << messages::response{ messages::status_codes::fail, "Server hashes files with " + algorithm.get_name() + " which the launcher doesn't support", {} };
+			return;
+		}
+
+		if (encrypted_stream && !input_data.has_capability(messages::capabilities::tls_stream))
+		{
+			response_stream << messages::response{ messages::status_codes::fail, "Server sends files only through tls which the launcher doesn't support", {} };
+			return;
+		}
+
+		messages::response response{ messages::status_codes::success, "Server response", { algorithm.get_name() } };
+
+		if (encrypted_stream)
+		{
+			response.response_content.push_back(messages::capabilities::tls_stream);
+		}
+
+		// Compressed chunks are decompressed by the launcher while writing.
+		compression = input_data.has_capability(messages::capabilities::zstd);
+
+		if (compression)
+		{
+			response.response_content.push_back(messages::capabilities::zstd);
 		}
+
+		// Launcher follows a file per channel.
+		multiplexing = input_data.has_capability(messages::capabilities::channels);
+
+		if (multiplexing)
+		{
+			response.response_content.push_back(messages::capabilities::channels);
+		}
+
+		response_stream << response;
 	}
 
-	void session::handle_general_hash_check(messages::request& input_data, boost::archive::binary_oarchive& response_stream)
+	void session::handle_general_hash_check(const messages::request_view& input_data, messages::message_writer& response_stream)
 	{
 		bool hash_status = fh_ptr->compare_general_hash(input_data.get_general_hash());
 		messages::response response{};
@@ -158,82 +378,589 @@ namespace launcher
 		response_stream << response;
 	}
 
-	asio::awaitable<void> session::handle_update(messages::request& input_data, boost::archive::binary_oarchive& response_stream)
+	void session::handle_merkle_nodes(const messages::request_view& input_data, messages::message_writer& response_stream)
 	{
-		messages::response response = messages::response{ messages::status_codes::success };
+		messages::response response{ messages::status_codes::success, {}, {} };
+
+		try
+		{
+			if (!sign_in_status)
+			{
+				response = messages::response{ messages::status_codes::not_authorized, "you need to sign in before downloading the update", {} };
+			}
+			else
+			{
+				auto manifest = fh_ptr->get_manifest();
+
+				for (auto&& [level, index] : input_data.get_merkle_nodes())
+				{
+					if (level >= merkle_tree::depth)
+					{
+						throw std::runtime_error{ "merkle node has no children" };
+					}
+
+					std::ranges::move(manifest->tree.get_children(level, index), std::back_inserter(response.response_content));
+				}
+			}
+		}
+		catch (std::exception& e)
+		{
+			response = messages::response{ messages::status_codes::fail, e.what(), {} };
+		}
+
+		response_stream << response;
+	}
+
+	void session::handle_merkle_buckets(const messages::request_view& input_data, messages::message_writer& response_stream)
+	{
+		messages::response response{ messages::status_codes::success, {}, {} };
+
+		try
+		{
+			if (!sign_in_status)
+			{
+				response = messages::response{ messages::status_codes::not_authorized, "you need to sign in before downloading the update", {} };
+			}
+			else
+			{
+				auto manifest = fh_ptr->get_manifest();
+
+				for (auto&& [level, index] : input_data.get_merkle_nodes())
+				{
+					if (level != merkle_tree::depth)
+					{
+						throw std::runtime_error{ "merkle node is not a bucket" };
+					}
+
+					for (auto&& [name, hash] : manifest->tree.get_bucket_files(index))
+					{
+						response.response_content.push_back(name);
+						response.response_content.push_back(hash);
+					}
+				}
+			}
+		}
+		catch (std::exception& e)
+		{
+			response = messages::response{ messages::status_codes::fail, e.what(), {} };
+		}
+
+		response_stream << response;
+	}
+
+	void session::handle_sync(const messages::request_view& input_data, messages::message_writer& response_stream)
+	{
+		messages::response response{ messages::status_codes::success, {}, {} };
+
+		try
+		{
+			// Pin the manifest, so the hash check and the listed files describe the same version.
+			auto manifest = fh_ptr->get_manifest();
+
+			if (manifest->general_hash_base64 != input_data.get_general_hash())
+			{
+				if (!sign_in_status)
+				{
+					response = messages::response{ messages::status_codes::not_authorized, "you need to sign in before downloading the update", {} };
+				}
+				else
+				{
+					response.status = messages::status_codes::hash_miss;
+
+					// Client is on a recent release, its plan is ready. Otherwise the client walks
+					// subtrees whose hashes differ from its digest with node requests.
+					if (auto plan = manifest->release_plans.find(input_data.get_general_hash()); plan != manifest->release_plans.end())
+					{
+						response.response_content.reserve(plan->second.size() + 1);
+						response.response_content.push_back(messages::sync_answers::plan);
+						response.response_content.insert(response.response_content.end(), plan->second.begin(), plan->second.end());
+					}
+					else
+					{
+						auto client_digest = input_data.get_tree_digest();
+						auto server_digest = manifest->tree.get_digest();
+						bool digest_valid = client_digest.size() == server_digest.size();
+
+						response.response_content.push_back(messages::sync_answers::nodes);
+
+						for (uint32_t index = 0; index * merkle_tree::digest_prefix_size < server_digest.size(); index++)
+						{
+							auto offset = index * merkle_tree::digest_prefix_size;
+
+							// Subtrees that are empty on the server contain nothing to download.
+							if (manifest->tree.get_node(merkle_tree::digest_level, index).empty())
+							{
+								continue;
+							}
+
+							if (!digest_valid || client_digest.compare(offset, merkle_tree::digest_prefix_size, server_digest, offset, merkle_tree::digest_prefix_size))
+							{
+								response.response_content.push_back(merkle_tree::make_node_id(merkle_tree::digest_level, index));
+							}
+						}
+					}
+				}
+			}
+		}
+		catch (std::exception& e)
+		{
+			response = messages::response{ messages::status_codes::fail, e.what(), {} };
+		}
+
+		response_stream << response;
+	}
+
+	asio::awaitable<void> session::handle_update(const messages::request_view& input_data, messages::message_writer& response_stream)
+	{
+		messages::response response = messages::response{ messages::status_codes::success, {}, {} };
+
+		stream_sent = 0;
+		stream_acked = 0;
 
 		while (true)
 		{
 			if (!sign_in_status)
 			{
-				response = messages::response{ messages::status_codes::not_authorized, "you need to sign in before downloading the update" };
+				response = messages::response{ messages::status_codes::not_authorized, "you need to sign in before downloading the update", {} };
 				break;
 			}
 
-			// std::map with all file data from file_handler module.
-			auto& map_with_files = fh_ptr->get_file_list();
+			// Pin the manifest for the whole transfer, the watcher may publish a new one meanwhile.
+			auto manifest = fh_ptr->get_manifest();
+
+			// Client has already found the differing files by walking the merkle tree.
+			auto entries = input_data.get_update_entries();
+			std::deque<messages::update_entry> queue{ std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()) };
+
+			// Every channel takes the next file from the queue once its current file is sent.
+			uint16_t channels = static_cast<uint16_t>(std::min<size_t>(multiplexing ? common::consts::update_channels : 1, queue.size()));
+			uint16_t running = channels;
+			std::exception_ptr failure;
+			asio::steady_timer channels_finished{ ssl_stream.get_executor(), asio::steady_timer::time_point::max() };
+
+			for (uint16_t channel = 0; channel < channels; channel++)
+			{
+				asio::co_spawn(ssl_stream.get_executor(), send_channel(*manifest, queue, channel), [&](std::exception_ptr e)
+					{
+						if (e && !failure)
+						{
+							failure = e;
+						}
+
+						if (--running == 0)
+						{
+							channels_finished.cancel();
+						}
+					});
+			}
+
+			while (running)
+			{
+				boost::system::error_code e;
+				co_await channels_finished.async_wait(asio::redirect_error(asio::use_awaitable, e));
+			}
+
+			if (failure)
+			{
+				std::rethrow_exception(failure);
+			}
+
+			break;
+		}
+
+		// Write 'end' frame and wait until the client receives everything, so no acknowledgements are left in the ssl layer.
+		co_await send_frame(0, messages::frame_types::end);
+		co_await flush_stream();
+		co_await receive_acks(stream_sent);
+
+		response_stream << response;
+	}
+
+	asio::awaitable<void> session::send_channel(const manifest& manifest, std::deque<messages::update_entry>& queue, uint16_t channel)
+	{
+		while (queue.size())
+		{
+			auto entry = std::move(queue.front());
+			queue.pop_front();
+
+			co_await send_file(manifest, entry, channel);
+		}
+	}
+
+	asio::awaitable<void> session::send_file(const manifest& manifest, const messages::update_entry& entry, uint16_t channel)
+	{
+		auto file = manifest.file_list.find(entry.file_name);
 
-			std::vector<std::pair<std::string, std::string>> file_list_client = input_data.get_files_hash();
-			auto file_list_server = std::views::transform(map_with_files, [](auto&& elem) { return std::pair<std::string, std::string>{ elem.first, elem.second.second }; });
-			std::vector<std::pair<std::string, std::string>> diff;
+		// File was removed after the client walked the tree.
+		if (file == manifest.file_list.end())
+		{
+			co_return;
+		}
 
-			// Get differences between server and client files.
-			std::ranges::set_difference(file_list_server, file_list_client, std::back_inserter(diff));
+		// Chunks are sent straight from the mapped file.
+		file_view view{ file->second.first };
+		uint64_t offset = 0;
 
-			bool stopper;
+		// Write transfer mode, size and name of the file. Partial copy left by an interrupted transfer is continued,
+		// its offset is at a block boundary. Delta pays off only for large files the client already has.
+		auto mode = messages::transfer_modes::full;
 
-			for (auto&& file : diff)
+		if (entry.resume_offset && entry.resume_offset % common::consts::MiB == 0 && entry.resume_offset <= view.size())
+		{
+			mode = messages::transfer_modes::resume;
+			offset = entry.resume_offset;
+		}
+		else if (entry.local_hashes.size() && view.size() >= common::consts::delta_min_file_size)
+		{
+			mode = messages::transfer_modes::delta;
+		}
+
+		// Client reserves space for the whole file up front.
+		std::array<char, sizeof(mode) + sizeof(uint64_t)> file_info;
+		uint64_t file_size = view.size();
+		memcpy(file_info.data(), &mode, sizeof(mode));
+		memcpy(file_info.data() + sizeof(mode), &file_size, sizeof(file_size));
+
+		co_await send_frame(channel, messages::frame_types::file, asio::buffer(file_info), asio::buffer(file->first));
+
+		if (mode == messages::transfer_modes::delta)
+		{
+			co_await send_delta(channel, view, file->second.second, file->second.first, entry.local_hashes);
+		}
+		// Blocks of the pre-compressed copy are sent as data frames.
+		else if (auto stored = compression ? cs_ptr->find(file->second.second) : nullptr)
+		{
+			co_await send_stored_file(channel, *stored, offset / common::consts::MiB);
+		}
+		else
+		{
+			view.will_need(offset, common::consts::readahead_size);
+
+			// Send file in chunks of 1 MiB.
+			while (offset < view.size())
 			{
-				std::string absolute_path = map_with_files.at(file.first).first;
-				uint64_t file_size = std::filesystem::file_size(absolute_path);
-				uint32_t chunk_size;
+				uint32_t chunk_size = std::min<uint64_t>(view.size() - offset, common::consts::MiB);
+
+				// Keep readahead one window in front of the socket.
+				if (offset % common::consts::readahead_size == 0)
+				{
+					view.will_need(offset + common::consts::readahead_size, common::consts::readahead_size);
+				}
+
+				co_await send_data(channel, view, file->second.second, offset, chunk_size);
+
+				offset += chunk_size;
+			}
+		}
+
+		co_await send_frame(channel, messages::frame_types::end_of_file);
+	}
+
+	asio::awaitable<void> session::acquire_writer()
+	{
+		// Channel that has just written a frame can't take the writer again ahead of the waiting ones.
+		uint64_t ticket = writer_tickets++;
+
+		// Timer never expires, waiters are woken up by cancellation and check their turn.
+		while (ticket != writer_serving)
+		{
+			boost::system::error_code e;
+			co_await writer_released.async_wait(asio::redirect_error(asio::use_awaitable, e));
+		}
+	}
+
+	asio::awaitable<void> session::write_secure(asio::const_buffer first, asio::const_buffer second)
+	{
+		std::array<asio::const_buffer, 2> buffers{ first, second };
+
+		if (kernel_tls_enabled)
+		{
+			co_await asio::async_write(ssl_stream.next_layer(), buffers, asio::use_awaitable);
+		}
+		else
+		{
+			co_await asio::async_write(ssl_stream, buffers, asio::use_awaitable);
+		}
+	}
+
+	asio::awaitable<void> session::write_stream(asio::const_buffer first, asio::const_buffer second)
+	{
+		if (encrypted_stream)
+		{
+			co_await write_secure(first, second);
+		}
+		else
+		{
+			std::array<asio::const_buffer, 2> buffers{ first, second };
+			co_await asio::async_write(ssl_stream.next_layer(), buffers, asio::use_awaitable);
+		}
+	}
+
+	asio::awaitable<void> session::begin_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head, uint32_t body_size)
+	{
+		messages::frame_header header{};
+		header.type = type;
+		header.channel = channel;
+		header.size = static_cast<uint32_t>(head.size() + body_size);
+
+		uint64_t frame_size = sizeof(header) + header.size;
+
+		// Window is exhausted, the client is behind.
+		if (stream_sent + frame_size > stream_acked + common::consts::stream_window_size)
+		{
+			co_await flush_stream();
+			co_await receive_acks(stream_sent + frame_size - common::consts::stream_window_size);
+		}
+
+		co_await flow->acquire(frame_size);
+
+		append_stream(asio::buffer(&header, sizeof(header)));
+		append_stream(head);
+		stream_sent += frame_size;
+	}
+
+	void session::append_stream(asio::const_buffer buffer)
+	{
+		auto data = static_cast<const char*>(buffer.data());
+		stream_buf.insert(stream_buf.end(), data, data + buffer.size());
+	}
+
+	asio::awaitable<void> session::send_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head, asio::const_buffer body)
+	{
+		co_await acquire_writer();
+		writer_guard guard{ *this };
+
+		co_await write_frame(channel, type, head, body);
+	}
+
+	asio::awaitable<void> session::write_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head, asio::const_buffer body)
+	{
+		co_await begin_frame(channel, type, head, static_cast<uint32_t>(body.size()));
+
+		// Small frames are collected, large data goes to the socket together with the collected ones.
+		if (body.size() < stream_buffer_size)
+		{
+			append_stream(body);
+
+			if (stream_buf.size() >= stream_buffer_size)
+			{
+				co_await flush_stream();
+			}
+		}
+		else
+		{
+			co_await write_stream(asio::buffer(stream_buf), body);
+			stream_buf.clear();
+		}
+	}
 
-				// Send file in chunks of 1 MiB.
-				std::vector<char> file_buff;
-				file_buff.resize(common::consts::MiB);
+	asio::awaitable<void> session::send_file_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head, const file_view& view, uint64_t offset, uint32_t size)
+	{
+		// Page faults and sendfile must not wait for the disk on the io thread. Other channels keep writing meanwhile.
+		co_await fr_ptr->make_resident(view, offset, size);
+
+		co_await acquire_writer();
+		writer_guard guard{ *this };
+
+		if (size < stream_buffer_size)
+		{
+			view.check_range(offset, size);
+			co_await write_frame(channel, type, head, asio::buffer(view.data() + offset, size));
+			co_return;
+		}
+
+		co_await begin_frame(channel, type, head, size);
+		co_await flush_stream();
 
-				std::ifstream ifstream(absolute_path, std::ios::binary);
-				if (!ifstream)
+#ifdef __linux__
+		// Pages go from the page cache to the socket without passing through the process.
+		if (zero_copy)
+		{
+			auto& socket = ssl_stream.next_layer();
+			off_t file_offset = offset;
+			uint64_t end = offset + size;
+
+			socket.native_non_blocking(true);
+
+			while (static_cast<uint64_t>(file_offset) < end)
+			{
+				auto result = ::sendfile(socket.native_handle(), view.native_handle(), &file_offset, end - file_offset);
+
+				if (result > 0)
 				{
-					throw std::runtime_error{ ("Fatal server error: failed to open file: " + std::filesystem::path{ absolute_path }.filename().string()).c_str() };
+					continue;
 				}
 
-				// Write file name.
-				co_await asio::async_write(ssl_stream, asio::buffer(file.first.data(), file.first.size() + 1), asio::use_awaitable);
+				if (result == 0)
+				{
+					throw std::runtime_error{ "file was truncated during the transfer" };
+				}
 
-				do
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					co_await socket.async_wait(asio::ip::tcp::socket::wait_write, asio::use_awaitable);
+				}
+				else if (errno != EINTR)
 				{
-					if (file_size < file_buff.size())
+					// Filesystem doesn't support sendfile, nothing of the frame is sent yet.
+					if ((errno == EINVAL || errno == ENOSYS) && static_cast<uint64_t>(file_offset) == offset)
 					{
-						file_buff.resize(file_size);
+						zero_copy = false;
+						break;
 					}
 
-					chunk_size = file_buff.size();
+					throw std::runtime_error{ std::string{ "sendfile failed: " } + strerror(errno) };
+				}
+			}
 
-					ifstream.read(file_buff.data(), chunk_size);
+			if (zero_copy)
+			{
+				co_return;
+			}
+		}
+#endif
 
-					// Write current size of chunk and chunk itself.
-					co_await asio::async_write(ssl_stream, asio::buffer(&chunk_size, sizeof(chunk_size)), asio::use_awaitable);
-					co_await asio::async_read(ssl_stream, asio::buffer(&stopper, sizeof(stopper)), asio::use_awaitable);
-					co_await asio::async_write(ssl_stream.next_layer(), asio::buffer(file_buff), asio::use_awaitable);
-					co_await asio::async_read(ssl_stream, asio::buffer(&stopper, sizeof(stopper)), asio::use_awaitable);
-					// These two asio::async_read lines are the necessary synchronization before and after non ssl transmission.
+		view.check_range(offset, size);
+		co_await write_stream(asio::buffer(view.data() + offset, size));
+	}
 
-					file_size -= chunk_size;
+	asio::awaitable<void> session::flush_stream()
+	{
+		if (stream_buf.size())
+		{
+			co_await write_stream(asio::buffer(stream_buf));
+			stream_buf.clear();
+		}
+	}
 
-				} while (file_size);
+	asio::awaitable<void> session::receive_acks(uint64_t target)
+	{
+		uint64_t ack;
+
+		while (stream_acked < target)
+		{
+			co_await asio::async_read(ssl_stream, asio::buffer(&ack, sizeof(ack)), asio::use_awaitable);
 
-				// If current file is over then send 0 and proceed to next file.
-				chunk_size = 0;
-				co_await asio::async_write(ssl_stream, asio::buffer(&chunk_size, sizeof(chunk_size)), asio::use_awaitable);
+			if (ack < stream_acked || ack > stream_sent)
+			{
+				throw std::runtime_error{ "invalid acknowledgement" };
 			}
 
-			break;
+			stream_acked = ack;
 		}
+	}
 
-		// Write 'stop' command at the end.
-		co_await asio::async_write(ssl_stream, asio::buffer("stop"), asio::use_awaitable);
+	asio::awaitable<void> session::send_data(uint16_t channel, const file_view& view, const std::string& file_hash, uint64_t offset, uint32_t size)
+	{
+		if (compression)
+		{
+			// Sessions downloading the same file share its compressed chunks.
+			auto chunk = cc_ptr->find(file_hash, offset, size);
 
-		response_stream << response;
+			if (chunk == nullptr)
+			{
+				co_await fr_ptr->make_resident(view, offset, size);
+
+				// Coroutine may resume on another thread, its thread local state is taken only now.
+				view.check_range(offset, size);
+				chunk = cc_ptr->insert(file_hash, offset, compress_chunk(view.data() + offset, size));
+			}
+
+			// Data that doesn't shrink is sent as is.
+			if (chunk->data.size())
+			{
+				co_await send_frame(channel, messages::frame_types::compressed_data, asio::buffer(&size, sizeof(size)), asio::buffer(chunk->data));
+				co_return;
+			}
+		}
+
+		co_await send_file_frame(channel, messages::frame_types::data, {}, view, offset, size);
+	}
+
+	asio::awaitable<void> session::send_stored_file(uint16_t channel, const compressed_store::compressed_file& file, uint64_t first_block)
+	{
+		auto& view = file.view;
+
+		if (first_block >= file.blocks.size())
+		{
+			co_return;
+		}
+
+		view.will_need(file.blocks[first_block].offset, common::consts::readahead_size);
+
+		for (auto&& block : std::span{ file.blocks }.subspan(first_block))
+		{
+			if (block.offset / common::consts::readahead_size != (block.offset + block.stored_size) / common::consts::readahead_size)
+			{
+				view.will_need(block.offset + block.stored_size, common::consts::readahead_size);
+			}
+
+			if (block.stored_size < block.raw_size)
+			{
+				co_await send_file_frame(channel, messages::frame_types::compressed_data, asio::buffer(&block.raw_size, sizeof(block.raw_size)), view, block.offset, block.stored_size);
+			}
+			else
+			{
+				co_await send_file_frame(channel, messages::frame_types::data, {}, view, block.offset, block.stored_size);
+			}
+		}
+	}
+
+	asio::awaitable<void> session::send_delta_frame(uint16_t channel, const file_view& view, const std::string& file_hash, const delta_frame& frame)
+	{
+		if (frame.type == messages::frame_types::copy)
+		{
+			std::array<uint32_t, 2> copy_range{ static_cast<uint32_t>(frame.first), frame.count };
+			co_await send_frame(channel, messages::frame_types::copy, asio::buffer(copy_range));
+		}
+		else if (frame.type == messages::frame_types::data)
+		{
+			view.will_need(frame.first, frame.count);
+			co_await send_data(channel, view, file_hash, frame.first, frame.count);
+		}
+	}
+
+	asio::awaitable<void> session::send_delta(uint16_t channel, const file_view& view, const std::string& file_hash, const std::string& path, const std::string& local_hashes)
+	{
+		auto chunks = co_await ci_ptr->get_chunks(file_hash, path);
+
+		// Key is chunk hash, value is index of the chunk in the local copy of the file.
+		std::unordered_map<std::string_view, uint32_t> local_chunks;
+
+		for (uint32_t j = 0; j < local_hashes.size() / content_chunker::chunk_hash_size; j++)
+		{
+			local_chunks.emplace(std::string_view{ local_hashes.data() + j * content_chunker::chunk_hash_size, content_chunker::chunk_hash_size }, j);
+		}
+
+		// Neighbouring chunks are merged into one frame while possible.
+		delta_frame pending{ messages::frame_types::end, 0, 0 };
+
+		for (auto&& chunk : *chunks)
+		{
+			if (auto local = local_chunks.find(chunk.hash); local != local_chunks.end())
+			{
+				if (pending.type == messages::frame_types::copy && pending.first + pending.count == local->second)
+				{
+					pending.count++;
+					continue;
+				}
+
+				co_await send_delta_frame(channel, view, file_hash, pending);
+				pending = delta_frame{ messages::frame_types::copy, local->second, 1 };
+			}
+			else
+			{
+				if (pending.type == messages::frame_types::data && pending.count + chunk.length <= common::consts::MiB)
+				{
+					pending.count += chunk.length;
+					continue;
+				}
+
+				co_await send_delta_frame(channel, view, file_hash, pending);
+				pending = delta_frame{ messages::frame_types::data, chunk.offset, chunk.length };
+			}
+		}
+
+		co_await send_delta_frame(channel, view, file_hash, pending);
 	}
-}
\ No newline at end of file
+}
@@ -2,9 +2,12 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <memory>
-#include "database.hpp"
-#include "file_handler.hpp"
+#include <deque>
+#include "session_modules.hpp"
 #include "common.hpp"
+#include "message_codec.hpp"
+#include "file_view.hpp"
+#include "recycling_allocator.hpp"
 #include <boost/uuid/random_generator.hpp>
 
 namespace asio = boost::asio;
@@ -17,7 +20,73 @@ namespace launcher
 		asio::ssl::stream<asio::ip::tcp::socket> ssl_stream;
 		std::shared_ptr<db::database> db_ptr;
 		std::shared_ptr<file_handler> fh_ptr;
+		std::shared_ptr<chunk_index> ci_ptr;
+		std::shared_ptr<compressed_store> cs_ptr;
+		std::shared_ptr<file_reader> fr_ptr;
+		std::shared_ptr<chunk_cache> cc_ptr;
+		std::shared_ptr<bandwidth_scheduler> bs_ptr;
 		bool sign_in_status = false;
+		bool compression = false; // negotiated during ping
+		bool encrypted_stream; // update stream goes through tls
+		bool kernel_tls_enabled = false; // kernel encrypts everything the session writes to the socket
+		bool multiplexing = false; // several files are sent at once, negotiated during ping
+
+		// State of the update stream.
+		std::vector<char, recycling_allocator<char>> stream_buf; // frames collected for the next write
+		uint64_t stream_sent = 0; // bytes of the stream including collected ones
+		uint64_t stream_acked = 0; // bytes received by the client
+		bool zero_copy = true; // data frames are sent with sendfile where possible
+		uint64_t writer_tickets = 0; // channels take the writer in the order they ask for it
+		uint64_t writer_serving = 0; // ticket of the channel writing its frame
+		asio::steady_timer writer_released; // never expires, cancelled when the writer is released
+		std::unique_ptr<bandwidth_scheduler::flow> flow; // share of the server's bandwidth
+
+		// Releases the writer of the update stream when the frame is written.
+		struct writer_guard
+		{
+			session& owner;
+
+			~writer_guard()
+			{
+				owner.writer_serving++;
+				owner.writer_released.cancel();
+			}
+		};
+
+		// Request read from the client and its response. Objects with grown buffers are reused
+		// by later requests of any session on the thread.
+		struct pending_request
+		{
+			messages::message_reader input;
+			messages::message_writer output;
+			messages::request_view request;
+		};
+
+		static thread_local std::vector<std::unique_ptr<pending_request>> request_pool;
+		uint32_t requests_running = 0; // requests processed concurrently with the read loop
+		asio::steady_timer requests_finished; // never expires, cancelled when a request is finished
+
+		// Frame of the delta transfer waiting for neighbouring chunks.
+		struct delta_frame
+		{
+			messages::frame_types type;
+			uint64_t first; // index of the local chunk for copies, offset in the file for data
+			uint32_t count; // number of chunks for copies, size for data
+		};
+
+	private:
+		/// <summary>
+		/// Take request object from the pool of the thread.
+		/// </summary>
+		/// <returns>Request object, possibly with buffers grown by earlier requests.</returns>
+		static std::unique_ptr<pending_request> take_request();
+
+		/// <summary>
+		/// Return request object to the pool of the thread. Objects with
+		/// large buffers are destroyed, so the pool stays small.
+		/// </summary>
+		/// <param name="pending">Finished request.</param>
+		static void recycle_request(std::unique_ptr<pending_request> pending);
 
 	public:
 		/// <summary>
@@ -25,9 +94,8 @@ namespace launcher
 		/// </summary>
 		/// <param name="ioc">Executor reference.</param>
 		/// <param name="ssl_context">Required data for the ssl protocol.</param>
-		/// <param name="db_ptr_">Pointer to database module.</param>
-		/// <param name="fh_ptr_">Pointer to file handler module.</param>
-		session(asio::io_context& ioc, asio::ssl::context& ssl_context, std::shared_ptr<db::database> db_ptr_, std::shared_ptr<file_handler> fh_ptr_);
+		/// <param name="modules">Database, file handler, chunk index, compressed store, file reader, chunk cache and bandwidth scheduler modules.</param>
+		session(asio::io_context& ioc, asio::ssl::context& ssl_context, const session_modules& modules);
 
 		/// <summary>
 		/// Main session event loop. Handles client's requests until disconnection.
@@ -35,13 +103,19 @@ namespace launcher
 		/// <param name="this_ptr">Pointer to object of session.</param>
 		static asio::awaitable<void> handle_client(std::shared_ptr<session> this_ptr);
 
+		/// <summary>
+		/// Process the request and write its response with the correlation id of the request.
+		/// </summary>
+		/// <param name="pending">Decoded request and buffer for the response.</param>
+		asio::awaitable<void> process_request(pending_request& pending);
+
 		/// <summary>
 		/// Handle client authorization request.
 		/// Function executes the corresponding database query.
 		/// </summary>
 		/// <param name="input_data">Client's login and password.</param>
 		/// <param name="response_stream">Response to client.</param>
-		asio::awaitable<void> handle_authorization(messages::request& input_data, boost::archive::binary_oarchive& response_stream);
+		asio::awaitable<void> handle_authorization(const messages::request_view& input_data, messages::message_writer& response_stream);
 
 		/// <summary>
 		/// Handle client sign up request. Function also
@@ -50,7 +124,15 @@ namespace launcher
 		/// </summary>
 		/// <param name="input_data">Login and password from client.</param>
 		/// <param name="response_stream">Response to client.</param>
-		asio::awaitable<void> handle_registration(messages::request& input_data, boost::archive::binary_oarchive& response_stream);
+		asio::awaitable<void> handle_registration(const messages::request_view& input_data, messages::message_writer& response_stream);
+
+		/// <summary>
+		/// Handle ping request. The client lists hash algorithms and capabilities it supports,
+		/// the response contains the algorithm of the server's manifest and accepted capabilities.
+		/// </summary>
+		/// <param name="input_data">Names of hash algorithms and capabilities supported by the client.</param>
+		/// <param name="response_stream">Response to client.</param>
+		void handle_ping(const messages::request_view& input_data, messages::message_writer& response_stream);
 
 		/// <summary>
 		/// Handle client general hash check request.
@@ -58,16 +140,184 @@ namespace launcher
 		/// </summary>
 		/// <param name="input_data">Contains general client hash.</param>
 		/// <param name="response_stream">Response to client.</param>
-		void handle_general_hash_check(messages::request& input_data, boost::archive::binary_oarchive& response_stream);
+		void handle_general_hash_check(const messages::request_view& input_data, messages::message_writer& response_stream);
+
+		/// <summary>
+		/// Handle request for merkle tree nodes. For every requested node
+		/// the response contains hashes of all its children, so the client
+		/// can find differing subtrees and descend only into them.
+		/// </summary>
+		/// <param name="input_data">Ids of inner nodes.</param>
+		/// <param name="response_stream">Response to client.</param>
+		void handle_merkle_nodes(const messages::request_view& input_data, messages::message_writer& response_stream);
+
+		/// <summary>
+		/// Handle request for content of merkle tree buckets.
+		/// The response contains name and hash of every file in requested buckets.
+		/// </summary>
+		/// <param name="input_data">Ids of bucket nodes.</param>
+		/// <param name="response_stream">Response to client.</param>
+		void handle_merkle_buckets(const messages::request_view& input_data, messages::message_writer& response_stream);
+
+		/// <summary>
+		/// Handle sync request, the update check in one round trip. If the general hash
+		/// differs, the response lists name and hash of every file that changed since the
+		/// client's release if it's a recent one. Otherwise it lists ids of merkle nodes whose
+		/// hashes differ from the client's digest, the client walks them with node requests.
+		/// </summary>
+		/// <param name="input_data">General hash and digest of the client's merkle tree.</param>
+		/// <param name="response_stream">Response to client.</param>
+		void handle_sync(const messages::request_view& input_data, messages::message_writer& response_stream);
 
 		/// <summary>
 		/// Handle client request update.
-		/// Since ssl protocol is too slow for transferring files, 
-		/// a regular tcp socket is used for this purpose.
+		/// Since OpenSSL is too slow for transferring files, the update stream is written
+		/// to the tcp socket directly, encrypted by kernel tls or unencrypted if the server
+		/// is configured so. Frames are sent without waiting for the client while the
+		/// unacknowledged part of the stream fits the window. Files are spread over
+		/// several channels, so a file waiting for the disk or for chunking doesn't
+		/// hold back the others.
 		/// </summary>
-		/// <param name="input_data">Hash of files from client.</param>
+		/// <param name="input_data">Names of files the client needs.</param>
 		/// <param name="response_stream">Final response to client.</param>
-		asio::awaitable<void> handle_update(messages::request& input_data, boost::archive::binary_oarchive& response_stream);
+		asio::awaitable<void> handle_update(const messages::request_view& input_data, messages::message_writer& response_stream);
+
+		/// <summary>
+		/// Send files from the shared queue on the channel until the queue is empty.
+		/// </summary>
+		/// <param name="manifest">Manifest pinned by the caller for the whole transfer.</param>
+		/// <param name="queue">Files that aren't taken by any channel yet.</param>
+		/// <param name="channel">Channel id.</param>
+		asio::awaitable<void> send_channel(const manifest& manifest, std::deque<messages::update_entry>& queue, uint16_t channel);
+
+		/// <summary>
+		/// Send file frame, frames of the file and 'end_of_file' frame.
+		/// </summary>
+		/// <param name="manifest">Manifest pinned by the caller for the whole transfer.</param>
+		/// <param name="entry">Requested file.</param>
+		/// <param name="channel">Channel id.</param>
+		asio::awaitable<void> send_file(const manifest& manifest, const messages::update_entry& entry, uint16_t channel);
+
+		/// <summary>
+		/// Wait until channels that asked for the writer earlier write their frames
+		/// and take the writer, writer_guard releases it.
+		/// </summary>
+		asio::awaitable<void> acquire_writer();
+
+		/// <summary>
+		/// Write data through the tls layer, the kernel's one if it's enabled.
+		/// </summary>
+		/// <param name="first">First part of the data.</param>
+		/// <param name="second">Second part of the data.</param>
+		asio::awaitable<void> write_secure(asio::const_buffer first, asio::const_buffer second = {});
+
+		/// <summary>
+		/// Write data of the update stream. It goes past the ssl layer
+		/// unless the stream must be encrypted by OpenSSL.
+		/// </summary>
+		/// <param name="first">First part of the data.</param>
+		/// <param name="second">Second part of the data.</param>
+		asio::awaitable<void> write_stream(asio::const_buffer first, asio::const_buffer second = {});
+
+		/// <summary>
+		/// Collect frame header and the head of the payload. Waits for acknowledgements
+		/// from the client if the window is exhausted and for the session's share of the bandwidth.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="type">Frame type.</param>
+		/// <param name="head">Small part of the payload.</param>
+		/// <param name="body_size">Size of the rest of the payload, the caller writes it.</param>
+		asio::awaitable<void> begin_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head, uint32_t body_size);
+
+		/// <summary>
+		/// Copy data to the collected frames.
+		/// </summary>
+		/// <param name="buffer">Data.</param>
+		void append_stream(asio::const_buffer buffer);
+
+		/// <summary>
+		/// Write frame of the update stream past the ssl layer. Waits for
+		/// acknowledgements from the client if the window is exhausted.
+		/// The caller must hold the writer.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="type">Frame type.</param>
+		/// <param name="head">Small part of the payload, it's always copied.</param>
+		/// <param name="body">Rest of the payload, large data is written without copying.</param>
+		asio::awaitable<void> write_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head = {}, asio::const_buffer body = {});
+
+		/// <summary>
+		/// Write whole frame of the channel, frames of other channels wait for it.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="type">Frame type.</param>
+		/// <param name="head">Small part of the payload, it's always copied.</param>
+		/// <param name="body">Rest of the payload, large data is written without copying.</param>
+		asio::awaitable<void> send_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head = {}, asio::const_buffer body = {});
+
+		/// <summary>
+		/// Write frame with a range of the file as the rest of the payload. On Linux large
+		/// ranges are sent with sendfile unless OpenSSL encrypts the stream, falling back
+		/// to writing from the mapping if the file system doesn't support it.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="type">Frame type.</param>
+		/// <param name="head">Small part of the payload, it's always copied.</param>
+		/// <param name="view">Mapped file.</param>
+		/// <param name="offset">Offset of the range.</param>
+		/// <param name="size">Size of the range.</param>
+		asio::awaitable<void> send_file_frame(uint16_t channel, messages::frame_types type, asio::const_buffer head, const file_view& view, uint64_t offset, uint32_t size);
+
+		/// <summary>
+		/// Write collected frames to the socket.
+		/// </summary>
+		asio::awaitable<void> flush_stream();
+
+		/// <summary>
+		/// Read acknowledgements of the update stream from the ssl layer.
+		/// </summary>
+		/// <param name="target">Number of bytes the client has to acknowledge.</param>
+		asio::awaitable<void> receive_acks(uint64_t target);
+
+		/// <summary>
+		/// Send data of the file, compressed on the fly if the client supports it.
+		/// Compressed chunks are shared with other sessions through the chunk cache.
+		/// Data that doesn't shrink is sent as is.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="view">Mapped file.</param>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <param name="offset">Offset of the data in the file.</param>
+		/// <param name="size">Size of the data, at most 1 MiB.</param>
+		asio::awaitable<void> send_data(uint16_t channel, const file_view& view, const std::string& file_hash, uint64_t offset, uint32_t size);
+
+		/// <summary>
+		/// Send the file from its pre-compressed copy, one frame per stored block.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="file">Compressed copy of the file.</param>
+		/// <param name="first_block">Index of the first block to send, blocks before it are already received by the client.</param>
+		asio::awaitable<void> send_stored_file(uint16_t channel, const compressed_store::compressed_file& file, uint64_t first_block = 0);
+
+		/// <summary>
+		/// Send pending frame of the delta transfer, 'end' is ignored.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="view">Mapped file.</param>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <param name="frame">Copy of local chunks or new data.</param>
+		asio::awaitable<void> send_delta_frame(uint16_t channel, const file_view& view, const std::string& file_hash, const delta_frame& frame);
+
+		/// <summary>
+		/// Send file as frames that rebuild it from the client's copy.
+		/// Chunks the client already has are referenced by index, the rest is sent as data.
+		/// </summary>
+		/// <param name="channel">Channel id.</param>
+		/// <param name="view">Mapped file.</param>
+		/// <param name="file_hash">Hash of the file in base64 encoding.</param>
+		/// <param name="path">Absolute path to the file.</param>
+		/// <param name="local_hashes">Packed chunk hashes of the client's copy.</param>
+		asio::awaitable<void> send_delta(uint16_t channel, const file_view& view, const std::string& file_hash, const std::string& path, const std::string& local_hashes);
 
 		/// <summary>
 		/// Get basic_socket object from ssl_stream.
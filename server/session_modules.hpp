@@ -0,0 +1,27 @@
+#pragma once
+#include <memory>
+#include "database.hpp"
+#include "file_handler.hpp"
+#include "chunk_index.hpp"
+#include "compressed_store.hpp"
+#include "file_reader.hpp"
+#include "chunk_cache.hpp"
+#include "bandwidth_scheduler.hpp"
+
+namespace launcher
+{
+	/// <summary>
+	/// Server modules shared by all sessions.
+	/// </summary>
+	struct session_modules
+	{
+		std::shared_ptr<db::database> database;
+		std::shared_ptr<file_handler> files;
+		std::shared_ptr<chunk_index> chunks;
+		std::shared_ptr<compressed_store> compressed;
+		std::shared_ptr<file_reader> reader;
+		std::shared_ptr<chunk_cache> hot_chunks;
+		std::shared_ptr<bandwidth_scheduler> bandwidth;
+		bool encrypted_stream = true; // send update stream through tls, kernel tls is used where available
+	};
+}
@@ -0,0 +1,234 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdint.h>
+
+namespace launcher
+{
+  /*
+  * Publication of immutable objects with epoch based reclamation.
+  * Readers pin the current object for as long as they need it, pinning
+  * is lock-free and never waits for writers. A writer swaps the pointer
+  * and retires the old object, which is destroyed only when no reader
+  * that could have seen it is still pinned. Reader slots aren't bound
+  * to threads, so a pin may be held across co_await.
+  */
+  template<typename T>
+  class snapshot_domain
+  {
+  private:
+    struct reader_slot
+    {
+      std::atomic<uint64_t> epoch{ 0 }; // zero means the slot isn't pinned
+      std::atomic<bool> in_use{ false };
+      reader_slot* next = nullptr;
+    };
+
+    struct retired_object
+    {
+      const T* ptr;
+      uint64_t epoch;
+    };
+
+    std::atomic<const T*> current{ nullptr };
+    std::atomic<uint64_t> global_epoch{ 1 };
+    std::atomic<reader_slot*> slots{ nullptr };
+    std::mutex writer_mutex; // writers only, readers never touch it
+    std::vector<retired_object> retired;
+
+  public:
+    /// <summary>
+    /// Pinned object. The object can't be destroyed while the guard is alive.
+    /// </summary>
+    class guard
+    {
+    private:
+      reader_slot* slot = nullptr;
+      const T* ptr = nullptr;
+
+    public:
+      guard() = default;
+
+      guard(reader_slot* slot_, const T* ptr_) : slot{ slot_ }, ptr{ ptr_ }
+      {}
+
+      guard(const guard&) = delete;
+      guard& operator=(const guard&) = delete;
+
+      guard(guard&& obj) noexcept : slot{ std::exchange(obj.slot, nullptr) }, ptr{ std::exchange(obj.ptr, nullptr) }
+      {}
+
+      guard& operator=(guard&& obj) noexcept
+      {
+        if (this != &obj)
+        {
+          release();
+          slot = std::exchange(obj.slot, nullptr);
+          ptr = std::exchange(obj.ptr, nullptr);
+        }
+
+        return *this;
+      }
+
+      ~guard()
+      {
+        release();
+      }
+
+      /// <summary>
+      /// Unpin the object before the guard goes out of scope.
+      /// </summary>
+      void release()
+      {
+        if (slot)
+        {
+          slot->epoch.store(0);
+          slot->in_use.store(false, std::memory_order_release);
+          slot = nullptr;
+          ptr = nullptr;
+        }
+      }
+
+      const T* operator->() const
+      {
+        return ptr;
+      }
+
+      const T& operator*() const
+      {
+        return *ptr;
+      }
+
+      explicit operator bool() const
+      {
+        return ptr != nullptr;
+      }
+    };
+
+  private:
+    /// <summary>
+    /// Find a free reader slot or add a new one. Lock-free.
+    /// </summary>
+    /// <returns>Slot owned by the caller.</returns>
+    reader_slot* acquire_slot()
+    {
+      for (auto slot = slots.load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+      {
+        bool expected = false;
+
+        if (!slot->in_use.load(std::memory_order_relaxed) && slot->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+          return slot;
+        }
+      }
+
+      auto slot = new reader_slot;
+      slot->in_use.store(true, std::memory_order_relaxed);
+      slot->next = slots.load(std::memory_order_relaxed);
+
+      while (!slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+      {}
+
+      return slot;
+    }
+
+    /// <summary>
+    /// Destroy retired objects that nobody can see anymore. Writer mutex must be held.
+    /// </summary>
+    void collect_locked()
+    {
+      uint64_t min_pinned_epoch = UINT64_MAX;
+
+      for (auto slot = slots.load(); slot != nullptr; slot = slot->next)
+      {
+        uint64_t epoch = slot->epoch.load();
+
+        if (epoch)
+        {
+          min_pinned_epoch = std::min(min_pinned_epoch, epoch);
+        }
+      }
+
+      std::erase_if(retired, [min_pinned_epoch](auto&& object)
+        {
+          if (object.epoch < min_pinned_epoch)
+          {
+            delete object.ptr;
+            return true;
+          }
+
+          return false;
+        });
+    }
+
+  public:
+    snapshot_domain() = default;
+    snapshot_domain(const snapshot_domain&) = delete;
+    snapshot_domain& operator=(const snapshot_domain&) = delete;
+
+    /// <summary>
+    /// Destroy all objects and slots. No guards may outlive the domain.
+    /// </summary>
+    ~snapshot_domain()
+    {
+      delete current.load();
+
+      for (auto&& object : retired)
+      {
+        delete object.ptr;
+      }
+
+      for (auto slot = slots.load(); slot != nullptr; )
+      {
+        delete std::exchange(slot, slot->next);
+      }
+    }
+
+    /// <summary>
+    /// Pin the current object. Never blocks.
+    /// </summary>
+    /// <returns>Guard with the pinned object. Empty if nothing was published yet.</returns>
+    guard pin()
+    {
+      auto slot = acquire_slot();
+
+      // Announce the epoch before reading the pointer. A writer that replaces
+      // the pointer after this point retires the old object with an epoch not
+      // less than ours and will keep it alive until we unpin.
+      slot->epoch.store(global_epoch.load());
+
+      return guard{ slot, current.load() };
+    }
+
+    /// <summary>
+    /// Make the object visible to new readers and retire the previous one.
+    /// </summary>
+    /// <param name="object">New object.</param>
+    void publish(std::unique_ptr<T> object)
+    {
+      std::lock_guard lock{ writer_mutex };
+
+      auto old_object = current.exchange(object.release());
+
+      if (old_object)
+      {
+        retired.push_back({ old_object, global_epoch.fetch_add(1) });
+      }
+
+      collect_locked();
+    }
+
+    /// <summary>
+    /// Destroy retired objects whose readers are gone.
+    /// </summary>
+    void collect()
+    {
+      std::lock_guard lock{ writer_mutex };
+      collect_locked();
+    }
+  };
+}